@@ -2,7 +2,7 @@
 #include <Adafruit_MCP23X17.h>
 
 //#define GPIOEXPANDERLIB_PRINT_DEBUG FALSE
-#include "../../../src/GpioExpanderLib.h"
+#include <GpioExpanderLib.h>
 
 // Pins for interrupt
 #define EXPANDER_INT_PIN 14      // microcontroller pin attached to INTA/B
@@ -0,0 +1,87 @@
+#ifndef GPIOEXPANDERNATIVETEST_H
+#define GPIOEXPANDERNATIVETEST_H
+
+// builds the library from ../../../src against the mocks in test/mock and steps its service task from the tests
+// each test program is a single translation unit, so the library sources are included here rather than linked
+
+#include "../../../src/GpioExpanderLib.cpp"
+#include "../../../src/GpioExpanderButtonHandler.cpp"
+#include "../../../src/GpioExpanderRotaryEncoderHandler.cpp"
+#include "../../../src/GpioExpanderKeypadHandler.cpp"
+#include "../../../src/GpioExpanderCodedSwitchHandler.cpp"
+#include "../../../src/GpioExpanderEventLog.cpp"
+
+struct GpioExpanderNativeTest
+{
+    // what the service task does when the expander raises an interrupt for pin
+    static void Interrupt(GpioExpander *expander, uint8_t pin)
+    {
+        expander->LockDevices();
+        expander->DispatchDevices(expander->_expander->getCapturedInterrupt(), pin);
+        expander->UnlockDevices();
+        GpioExpander::FlushDeferredEvents();
+    }
+
+    // what the service task does when its wait times out
+    static void ServiceTimers() { GpioExpander::ServiceTimers(); }
+
+    static TickType_t WaitTicks() { return GpioExpander::GetServiceWaitTicks(); }
+
+    static uint64_t ScanKeypad(GpioExpander *expander, GpioExpanderKeypad *keypad) { return expander->ScanKeypad(keypad); }
+
+    // one pass of the log task, which otherwise never returns
+    static void DrainEventLog() { GpioExpanderEventLog::Drain(); }
+
+    // forget anything recorded by an earlier test, so timestamps and drop counts start from zero
+    static void ResetEventLog()
+    {
+        GpioExpanderLogHead = 0;
+        GpioExpanderLogTail = 0;
+        GpioExpanderLogDroppedCount = 0;
+        GpioExpanderLogPendingDropped = 0;
+        GpioExpanderLogLastMillis = 0;
+    }
+};
+
+// the registry holds at most GPIOEXPANDER_MAX_EXPANDERS expanders, so tests allocate them and never free them
+struct GpioExpanderRig
+{
+    Adafruit_MCP23X17 *chip;
+    GpioExpander *expander;
+};
+
+inline GpioExpanderRig GpioExpanderMakeRig()
+{
+    GpioExpanderRig rig;
+    rig.chip = new Adafruit_MCP23X17();
+    rig.expander = new GpioExpander();
+    return rig;
+}
+
+// receive the next event of type T that was raised by expander, skipping events from other tests
+template <typename T>
+bool GpioExpanderReceive(QueueHandle_t queue, GpioExpander *expander, T &event)
+{
+    while (xQueueReceive(queue, &event, 0) == pdPASS)
+    {
+        if (event.expander == expander)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+inline void GpioExpanderDrainQueues()
+{
+    MockQueue *queues[] = {xGpioExpanderButtonEventQueue, xGpioExpanderRotaryEncoderEventQueue, xGpioExpanderKeypadEventQueue, xGpioExpanderCodedSwitchEventQueue};
+    for (MockQueue *queue : queues)
+    {
+        if (queue != nullptr)
+        {
+            queue->items.clear();
+        }
+    }
+}
+
+#endif // GPIOEXPANDERNATIVETEST_H
@@ -0,0 +1,171 @@
+#ifndef MOCK_ADAFRUIT_MCP23X17_H
+#define MOCK_ADAFRUIT_MCP23X17_H
+
+// host model of an MCP23017 behind the Adafruit driver API
+// inputs are pulled up; a closed contact (contacts) grounds a pin, a pressed key (keys) joins a row pin to a column pin.
+// without diodes current flows both ways through keys, so a pressed key pattern can ghost just like real hardware,
+// and a high output joined to a low output through keys is recorded as a short.
+// busTransactions counts the I2C transactions the real driver would issue for each call
+
+#include <Arduino.h>
+
+class Adafruit_MCP23X17
+{
+    public:
+        uint16_t iodir = 0xFFFF;    // 1 = input
+        uint16_t gppu = 0;
+        uint16_t olat = 0;
+        uint16_t gpinten = 0;
+        uint16_t contacts = 0;      // input pins grounded by a closed contact
+        uint64_t keys[16] = {};     // keys[row pin] has bit (column pin) set while that key is pressed
+        bool diodes = false;        // keys only conduct from the column to the row
+        bool shorted = false;       // a high output was ever joined to a low output
+        unsigned long busTransactions = 0;
+        void (*beforeRead)(Adafruit_MCP23X17 &chip) = nullptr;   // stands in for another task using the chip between transactions
+
+        void pressKey(uint8_t rowPin, uint8_t colPin) { keys[rowPin] |= (1ULL << colPin); }
+        void releaseKey(uint8_t rowPin, uint8_t colPin) { keys[rowPin] &= ~(1ULL << colPin); }
+        void releaseAllKeys() { memset(keys, 0, sizeof(keys)); }
+
+        // register reads and writes, each a single transaction
+        uint16_t readGPIOAB() { if (beforeRead != nullptr) { beforeRead(*this); } busTransactions++; return levels(); }
+        void writeGPIOAB(uint16_t value) { busTransactions++; olat = value; check(); }
+
+        // the driver does a read-modify-write of IODIR and of GPPU
+        void pinMode(uint8_t pin, uint8_t mode)
+        {
+            busTransactions += 4;
+            uint16_t bit = 1 << pin;
+            iodir = (mode == OUTPUT) ? (iodir & ~bit) : (iodir | bit);
+            gppu = (mode == INPUT_PULLUP) ? (gppu | bit) : (gppu & ~bit);
+            check();
+        }
+
+        // the driver reads GPIO and writes the result to the latch
+        void digitalWrite(uint8_t pin, uint8_t value)
+        {
+            busTransactions += 2;
+            uint16_t latch = (levels() & ~iodir) | (olat & iodir);
+            olat = value ? (latch | (1 << pin)) : (latch & ~(1 << pin));
+            check();
+        }
+
+        uint8_t digitalRead(uint8_t pin) { busTransactions++; return (levels() >> pin) & 1; }
+
+        void setupInterrupts(bool, bool, uint8_t) { busTransactions += 2; }
+        void setupInterruptPin(uint8_t pin, uint8_t = CHANGE) { busTransactions += 4; gpinten |= (1 << pin); }
+        void disableInterruptPin(uint8_t pin) { busTransactions += 2; gpinten &= ~(1 << pin); }
+        void clearInterrupts() { busTransactions++; }
+        uint8_t getLastInterruptPin() { busTransactions++; return 255; }
+        uint16_t getCapturedInterrupt() { return readGPIOAB(); }
+
+        // electrical level of every pin
+        uint16_t levels()
+        {
+            uint16_t result = 0;
+            for (uint8_t pin=0; pin<16; pin++)
+            {
+                result |= level(pin) << pin;
+            }
+            return result;
+        }
+
+    private:
+        bool isOutput(uint8_t pin) { return (iodir & (1 << pin)) == 0; }
+
+        bool joined(uint8_t a, uint8_t b) { return (keys[a] >> b & 1) || (keys[b] >> a & 1); }
+
+        // collect every pin connected to pin through pressed keys, stopping at driven outputs
+        uint32_t component(uint8_t pin)
+        {
+            uint32_t seen = 1u << pin;
+            uint32_t frontier = seen;
+            while (frontier != 0)
+            {
+                uint32_t next = 0;
+                for (uint8_t a=0; a<16; a++)
+                {
+                    if (!(frontier & (1u << a)) || (isOutput(a) && a != pin))
+                    {
+                        continue;
+                    }
+                    for (uint8_t b=0; b<16; b++)
+                    {
+                        if (!(seen & (1u << b)) && joined(a, b))
+                        {
+                            next |= 1u << b;
+                        }
+                    }
+                }
+                seen |= next;
+                frontier = next;
+            }
+            return seen;
+        }
+
+        uint16_t level(uint8_t pin)
+        {
+            if (isOutput(pin))
+            {
+                return (olat >> pin) & 1;
+            }
+            if (contacts & (1 << pin))
+            {
+                return 0;
+            }
+            if (diodes)
+            {
+                // a column only sees the rows its own pressed keys lead to
+                for (uint8_t row=0; row<16; row++)
+                {
+                    if ((keys[row] >> pin & 1) && isOutput(row) && !(olat & (1 << row)))
+                    {
+                        return 0;
+                    }
+                }
+                return 1;
+            }
+            uint32_t pins = component(pin);
+            for (uint8_t other=0; other<16; other++)
+            {
+                if ((pins & (1u << other)) && isOutput(other) && !(olat & (1 << other)))
+                {
+                    return 0;
+                }
+            }
+            return 1;
+        }
+
+        // without diodes, any key path between a high output and a low output is a short
+        void check()
+        {
+            if (diodes)
+            {
+                return;
+            }
+            for (uint8_t high=0; high<16; high++)
+            {
+                if (!isOutput(high) || !(olat & (1 << high)))
+                {
+                    continue;
+                }
+                for (uint8_t a=0; a<16; a++)
+                {
+                    if (!joined(high, a))
+                    {
+                        continue;
+                    }
+                    uint32_t pins = component(a) | (1u << a);
+                    for (uint8_t low=0; low<16; low++)
+                    {
+                        if ((pins & (1u << low)) && isOutput(low) && !(olat & (1 << low)))
+                        {
+                            shorted = true;
+                        }
+                    }
+                }
+            }
+        }
+};
+
+#endif // MOCK_ADAFRUIT_MCP23X17_H
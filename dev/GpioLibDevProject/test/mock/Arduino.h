@@ -0,0 +1,121 @@
+#ifndef MOCK_ARDUINO_H
+#define MOCK_ARDUINO_H
+
+// host stand-in for the parts of the Arduino-ESP32 core and FreeRTOS that the library uses
+// tasks are never started; the tests step the service task themselves through GpioExpanderNativeTest
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <limits.h>
+#include <deque>
+#include <vector>
+
+#define IRAM_ATTR
+#define LOW 0
+#define HIGH 1
+#define FALLING 2
+#define CHANGE 3
+#define INPUT 1
+#define OUTPUT 3
+#define INPUT_PULLUP 5
+#define TRUE 1
+#define FALSE 0
+#define LED_BUILTIN 13
+
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+typedef uint32_t TickType_t;
+typedef void *TaskHandle_t;
+typedef void *SemaphoreHandle_t;
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdPASS 1
+#define pdFAIL 0
+#define portMAX_DELAY 0xFFFFFFFFu
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define portYIELD_FROM_ISR(woken) (void)(woken)
+
+// queues hold copies of the items, and never block: a send to a full queue fails as if it had timed out
+struct MockQueue
+{
+    size_t length;
+    size_t itemSize;
+    std::deque<std::vector<uint8_t>> items;
+};
+typedef MockQueue *QueueHandle_t;
+
+inline QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) { return new MockQueue{length, itemSize, {}}; }
+inline BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t)
+{
+    if (queue == nullptr || queue->items.size() >= queue->length)
+    {
+        return pdFAIL;
+    }
+    const uint8_t *bytes = (const uint8_t *)item;
+    queue->items.push_back(std::vector<uint8_t>(bytes, bytes + queue->itemSize));
+    return pdPASS;
+}
+inline BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t)
+{
+    if (queue == nullptr || queue->items.empty())
+    {
+        return pdFAIL;
+    }
+    memcpy(item, queue->items.front().data(), queue->itemSize);
+    queue->items.pop_front();
+    return pdPASS;
+}
+inline UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) { return queue == nullptr ? 0 : queue->items.size(); }
+
+inline BaseType_t xTaskCreate(void (*)(void *), const char *, uint32_t, void *, UBaseType_t, TaskHandle_t *handle) { *handle = (TaskHandle_t)1; return pdPASS; }
+inline BaseType_t xTaskNotifyWait(uint32_t, uint32_t, uint32_t *, TickType_t) { return pdFAIL; }
+inline uint32_t ulTaskNotifyTake(BaseType_t, TickType_t) { return 0; }
+inline BaseType_t xTaskNotifyGive(TaskHandle_t) { return pdPASS; }
+inline void vTaskNotifyGiveFromISR(TaskHandle_t, BaseType_t *) {}
+
+inline SemaphoreHandle_t xSemaphoreCreateMutex() { return (SemaphoreHandle_t)1; }
+inline BaseType_t xSemaphoreTake(SemaphoreHandle_t, TickType_t) { return pdPASS; }
+inline BaseType_t xSemaphoreGive(SemaphoreHandle_t) { return pdPASS; }
+
+typedef struct { int unused; } portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED {0}
+inline void portENTER_CRITICAL(portMUX_TYPE *) {}
+inline void portEXIT_CRITICAL(portMUX_TYPE *) {}
+
+// time only moves when a test moves it
+inline unsigned long mockMillis = 0;
+inline unsigned long millis() { return mockMillis; }
+inline unsigned long micros() { return mockMillis * 1000; }
+
+// the MCU INT lines idle high, so the service task never finds a pending interrupt on its own
+inline void pinMode(uint8_t, uint8_t) {}
+inline void digitalWrite(uint8_t, uint8_t) {}
+inline int digitalRead(uint8_t) { return HIGH; }
+inline uint8_t digitalPinToInterrupt(uint8_t pin) { return pin; }
+inline void attachInterrupt(uint8_t, void (*)(), int) {}
+inline void detachInterrupt(uint8_t) {}
+
+class Print
+{
+    public:
+        virtual ~Print() {}
+        virtual size_t write(uint8_t) = 0;
+        virtual size_t write(const uint8_t *data, size_t length) { for (size_t i=0; i<length; i++) { write(data[i]); } return length; }
+        size_t print(const char *) { return 0; }
+        size_t print(long) { return 0; }
+        size_t println(const char *) { return 0; }
+        size_t println(long) { return 0; }
+        size_t println() { return 0; }
+};
+
+class MockSerial : public Print
+{
+    public:
+        using Print::write;
+        size_t write(uint8_t) { return 1; }
+};
+inline MockSerial Serial;
+
+#endif // MOCK_ARDUINO_H
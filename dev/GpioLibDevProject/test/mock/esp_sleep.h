@@ -0,0 +1,8 @@
+#ifndef MOCK_ESP_SLEEP_H
+#define MOCK_ESP_SLEEP_H
+
+typedef int esp_err_t;
+
+inline esp_err_t esp_sleep_enable_gpio_wakeup() { return 0; }
+
+#endif // MOCK_ESP_SLEEP_H
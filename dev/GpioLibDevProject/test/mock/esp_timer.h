@@ -0,0 +1,11 @@
+#ifndef MOCK_ESP_TIMER_H
+#define MOCK_ESP_TIMER_H
+
+#include <chrono>
+
+inline int64_t esp_timer_get_time()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#endif // MOCK_ESP_TIMER_H
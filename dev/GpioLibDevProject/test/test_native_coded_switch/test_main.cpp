@@ -0,0 +1,171 @@
+#include <unity.h>
+
+#include "../GpioExpanderNativeTest.h"
+
+static const uint8_t pinsA[] = {0, 1, 2, 3};
+static const uint8_t pinsB[] = {8, 9, 10, 11};
+
+void setUp()
+{
+    GpioExpanderDrainQueues();
+    mockMillis = 1000;
+}
+
+void tearDown()
+{
+}
+
+// contacts are active low, so a closed contact reads as a 0 on its pin
+static int16_t decode(GpioExpanderCodedSwitchEncoding encoding, uint8_t pinCount, uint16_t code)
+{
+    static const uint8_t pins[] = {0, 1, 2, 3, 4, 5, 6, 7};
+    GpioExpanderCodedSwitch device;
+    device.encoding = encoding;
+    device.pinCount = pinCount;
+    memcpy(device.pins, pins, pinCount);
+    return GpioExpanderCodedSwitchDecode(&device, (uint16_t)~code);
+}
+
+void test_decode()
+{
+    for (uint16_t n=0; n<16; n++)
+    {
+        TEST_ASSERT_EQUAL_INT16(n, decode(CodedBinary, 4, n));
+        TEST_ASSERT_EQUAL_INT16(n, decode(CodedGray, 4, n ^ (n >> 1)));
+        TEST_ASSERT_EQUAL_INT16(n <= 9 ? n : GPIOEXPANDER_CODEDSWITCH_INVALID, decode(CodedBcd, 4, n));
+    }
+    TEST_ASSERT_EQUAL_INT16(42, decode(CodedBcd, 8, 0x42));
+    TEST_ASSERT_EQUAL_INT16(GPIOEXPANDER_CODEDSWITCH_INVALID, decode(CodedBcd, 8, 0xA2));
+
+    for (uint8_t k=0; k<8; k++)
+    {
+        TEST_ASSERT_EQUAL_INT16(k, decode(CodedOneHot, 8, 1 << k));
+    }
+    TEST_ASSERT_EQUAL_INT16(GPIOEXPANDER_CODEDSWITCH_INVALID, decode(CodedOneHot, 8, 0));
+    TEST_ASSERT_EQUAL_INT16(GPIOEXPANDER_CODEDSWITCH_INVALID, decode(CodedOneHot, 8, 0x06));
+}
+
+// move the contacts and raise the interrupt for the pins that changed
+static void move(GpioExpanderRig &rig, uint16_t contacts, uint8_t pin)
+{
+    rig.chip->contacts = contacts;
+    GpioExpanderNativeTest::Interrupt(rig.expander, pin);
+}
+
+void test_transitional_codes_report_once_after_settle()
+{
+    GpioExpanderRig rig = GpioExpanderMakeRig();
+    rig.chip->contacts = 0x3;
+    GpioExpanderCodedSwitch *device = rig.expander->AddCodedSwitch(pinsA, 4, CodedBinary, 20);
+    rig.expander->Init(rig.chip, 14);
+    TEST_ASSERT_EQUAL_INT16(3, device->value);
+    TEST_ASSERT_EQUAL_UINT32(portMAX_DELAY, GpioExpanderNativeTest::WaitTicks());
+
+    // a binary switch moving from 3 to 4 opens and closes its contacts one at a time
+    move(rig, 0x7, 2);
+    mockMillis += 2;
+    move(rig, 0x5, 1);
+    mockMillis += 2;
+    move(rig, 0x4, 0);
+    TEST_ASSERT_TRUE(device->isSettling);
+    TEST_ASSERT_EQUAL_UINT32(pdMS_TO_TICKS(20), GpioExpanderNativeTest::WaitTicks());
+
+    GpioExpanderCodedSwitchEvent event;
+    mockMillis += 10;
+    GpioExpanderNativeTest::ServiceTimers();
+    TEST_ASSERT_FALSE(GpioExpanderReceive(xGpioExpanderCodedSwitchEventQueue, rig.expander, event));
+
+    mockMillis += 10;
+    GpioExpanderNativeTest::ServiceTimers();
+    TEST_ASSERT_TRUE(GpioExpanderReceive(xGpioExpanderCodedSwitchEventQueue, rig.expander, event));
+    TEST_ASSERT_EQUAL_INT16(4, event.value);
+    TEST_ASSERT_EQUAL_INT16(3, event.previousValue);
+    TEST_ASSERT_TRUE(event.device == device);
+    TEST_ASSERT_FALSE(GpioExpanderReceive(xGpioExpanderCodedSwitchEventQueue, rig.expander, event));
+    TEST_ASSERT_FALSE(device->isSettling);
+    TEST_ASSERT_EQUAL_UINT32(portMAX_DELAY, GpioExpanderNativeTest::WaitTicks());
+}
+
+void test_bounce_back_reports_nothing()
+{
+    GpioExpanderRig rig = GpioExpanderMakeRig();
+    rig.chip->contacts = 0x1;
+    GpioExpanderCodedSwitch *device = rig.expander->AddCodedSwitch(pinsA, 4, CodedGray, 20);
+    rig.expander->Init(rig.chip, 14);
+
+    move(rig, 0x3, 1);
+    TEST_ASSERT_TRUE(device->isSettling);
+    mockMillis += 5;
+    move(rig, 0x1, 1);
+    TEST_ASSERT_FALSE(device->isSettling);
+
+    mockMillis += 50;
+    GpioExpanderNativeTest::ServiceTimers();
+    GpioExpanderCodedSwitchEvent event;
+    TEST_ASSERT_FALSE(GpioExpanderReceive(xGpioExpanderCodedSwitchEventQueue, rig.expander, event));
+    TEST_ASSERT_EQUAL_INT16(1, device->value);
+}
+
+void test_invalid_snapshot_is_confirmed_by_the_settle_read()
+{
+    GpioExpanderRig rig = GpioExpanderMakeRig();
+    rig.chip->contacts = 0x0200;
+    GpioExpanderCodedSwitch *device = rig.expander->AddCodedSwitch(pinsB, 4, CodedOneHot, 20);
+    rig.expander->Init(rig.chip, 14);
+    TEST_ASSERT_EQUAL_INT16(1, device->value);
+
+    // the interrupt captures the wiper touching two contacts, and it reaches the next one before the capture is cleared
+    move(rig, 0x0600, 10);
+    TEST_ASSERT_TRUE(device->isSettling);
+    rig.chip->contacts = 0x0400;
+
+    // the settle read finds the final position, which is reported once it has held for the settle time too
+    GpioExpanderCodedSwitchEvent event;
+    mockMillis += 20;
+    GpioExpanderNativeTest::ServiceTimers();
+    TEST_ASSERT_FALSE(GpioExpanderReceive(xGpioExpanderCodedSwitchEventQueue, rig.expander, event));
+    TEST_ASSERT_TRUE(device->isSettling);
+    TEST_ASSERT_EQUAL_INT16(2, device->pendingValue);
+
+    mockMillis += 20;
+    GpioExpanderNativeTest::ServiceTimers();
+    TEST_ASSERT_TRUE(GpioExpanderReceive(xGpioExpanderCodedSwitchEventQueue, rig.expander, event));
+    TEST_ASSERT_EQUAL_INT16(2, event.value);
+    TEST_ASSERT_EQUAL_INT16(1, event.previousValue);
+    TEST_ASSERT_FALSE(device->isSettling);
+}
+
+void test_switch_left_between_positions_reports_nothing()
+{
+    GpioExpanderRig rig = GpioExpanderMakeRig();
+    rig.chip->contacts = 0x0100;
+    GpioExpanderCodedSwitch *device = rig.expander->AddCodedSwitch(pinsB, 4, CodedOneHot, 20);
+    rig.expander->Init(rig.chip, 14);
+
+    move(rig, 0x0000, 8);
+    mockMillis += 20;
+    GpioExpanderNativeTest::ServiceTimers();
+    GpioExpanderCodedSwitchEvent event;
+    TEST_ASSERT_FALSE(GpioExpanderReceive(xGpioExpanderCodedSwitchEventQueue, rig.expander, event));
+    TEST_ASSERT_FALSE(device->isSettling);
+    TEST_ASSERT_EQUAL_INT16(0, device->value);
+    TEST_ASSERT_EQUAL_UINT32(portMAX_DELAY, GpioExpanderNativeTest::WaitTicks());
+
+    // reaching the next position is reported as usual
+    move(rig, 0x0200, 9);
+    mockMillis += 20;
+    GpioExpanderNativeTest::ServiceTimers();
+    TEST_ASSERT_TRUE(GpioExpanderReceive(xGpioExpanderCodedSwitchEventQueue, rig.expander, event));
+    TEST_ASSERT_EQUAL_INT16(1, event.value);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_decode);
+    RUN_TEST(test_transitional_codes_report_once_after_settle);
+    RUN_TEST(test_bounce_back_reports_nothing);
+    RUN_TEST(test_invalid_snapshot_is_confirmed_by_the_settle_read);
+    RUN_TEST(test_switch_left_between_positions_reports_nothing);
+    return UNITY_END();
+}
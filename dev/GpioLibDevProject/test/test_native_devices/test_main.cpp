@@ -0,0 +1,170 @@
+#include <unity.h>
+
+#include "../GpioExpanderNativeTest.h"
+
+// register state of the mock chip, to check which bits a runtime change touched
+struct Registers
+{
+    uint16_t iodir;
+    uint16_t gppu;
+    uint16_t gpinten;
+    unsigned long busTransactions;
+
+    Registers(const Adafruit_MCP23X17 *chip) : iodir(chip->iodir), gppu(chip->gppu), gpinten(chip->gpinten), busTransactions(chip->busTransactions) {}
+};
+
+// assert that only the given bits of each register changed, at the given cost
+static void assert_changed(const Registers &before, const Adafruit_MCP23X17 *chip, uint16_t iodir, uint16_t gppu, uint16_t gpinten, unsigned long transactions)
+{
+    TEST_ASSERT_EQUAL_HEX16(iodir, before.iodir ^ chip->iodir);
+    TEST_ASSERT_EQUAL_HEX16(gppu, before.gppu ^ chip->gppu);
+    TEST_ASSERT_EQUAL_HEX16(gpinten, before.gpinten ^ chip->gpinten);
+    TEST_ASSERT_EQUAL_UINT32(transactions, chip->busTransactions - before.busTransactions);
+}
+
+// mock cost of configuring and releasing one input pin, see test/mock/Adafruit_MCP23X17.h
+static const unsigned long addInput = 4 + 4;    // pinMode(INPUT_PULLUP) and setupInterruptPin
+static const unsigned long removeInput = 2 + 4; // disableInterruptPin and pinMode(INPUT)
+static const unsigned long seed = 1;            // one readGPIOAB for every seeded device
+
+static GpioExpanderRig rig;
+static GpioExpanderRotaryEncoder *encoder;
+
+void setUp()
+{
+    GpioExpanderDrainQueues();
+    mockMillis = 1000;
+}
+
+void tearDown()
+{
+}
+
+void test_init_configures_devices_added_before_it()
+{
+    rig = GpioExpanderMakeRig();
+    rig.expander->AddButton(3);
+    encoder = rig.expander->AddRotaryEncoder(4, 5);
+    rig.expander->Init(rig.chip, 14);
+
+    TEST_ASSERT_EQUAL_HEX16(0xFFFF, rig.chip->iodir);
+    TEST_ASSERT_EQUAL_HEX16(0x0038, rig.chip->gppu);
+    TEST_ASSERT_EQUAL_HEX16(0x0038, rig.chip->gpinten);
+}
+
+void test_add_after_init_configures_only_the_new_pins()
+{
+    // a button on a pin that is already held down starts out pressed without an event
+    rig.chip->contacts = 0x0040;
+    Registers before(rig.chip);
+    GpioExpanderButton *button = rig.expander->AddButton(6);
+    TEST_ASSERT_TRUE(button != nullptr);
+    assert_changed(before, rig.chip, 0, 0x0040, 0x0040, addInput + seed);
+    TEST_ASSERT_EQUAL_UINT8(LOW, button->lastState);
+
+    rig.chip->contacts = 0x0100;
+    before = Registers(rig.chip);
+    GpioExpanderRotaryEncoder *second = rig.expander->AddRotaryEncoder(8, 9);
+    TEST_ASSERT_TRUE(second != nullptr);
+    assert_changed(before, rig.chip, 0, 0x0300, 0x0300, 2 * addInput + seed);
+    TEST_ASSERT_EQUAL_UINT8(0, second->pin1State);
+    TEST_ASSERT_EQUAL_UINT8(1, second->pin2State);
+
+    // pins that are already taken are refused without touching the chip
+    before = Registers(rig.chip);
+    TEST_ASSERT_TRUE(rig.expander->AddButton(9) == nullptr);
+    TEST_ASSERT_TRUE(rig.expander->AddRotaryEncoder(3, 10) == nullptr);
+    assert_changed(before, rig.chip, 0, 0, 0, 0);
+
+    GpioExpanderButtonEvent event;
+    GpioExpanderNativeTest::Interrupt(rig.expander, 255);
+    TEST_ASSERT_FALSE(GpioExpanderReceive(xGpioExpanderButtonEventQueue, rig.expander, event));
+    rig.chip->contacts = 0;
+}
+
+void test_remove_releases_only_the_removed_pins()
+{
+    Registers before(rig.chip);
+    TEST_ASSERT_TRUE(rig.expander->RemoveButton(6));
+    assert_changed(before, rig.chip, 0, 0x0040, 0x0040, removeInput);
+    TEST_ASSERT_FALSE(rig.expander->RemoveButton(6));
+
+    before = Registers(rig.chip);
+    TEST_ASSERT_TRUE(rig.expander->RemoveRotaryEncoder(rig.expander->GetRotaryEncoder(1)));
+    assert_changed(before, rig.chip, 0, 0x0300, 0x0300, 2 * removeInput);
+
+    // the released pins are free for a new device again
+    TEST_ASSERT_TRUE(rig.expander->AddButton(9) != nullptr);
+    TEST_ASSERT_TRUE(rig.expander->RemoveButton(9));
+    TEST_ASSERT_EQUAL_HEX16(0x0038, rig.chip->gpinten);
+}
+
+void test_remap_onto_own_pins()
+{
+    // a button remapped onto its own pin and an encoder with its pins swapped need no pin changes
+    Registers before(rig.chip);
+    TEST_ASSERT_TRUE(rig.expander->RemapButton(3, 3));
+    assert_changed(before, rig.chip, 0, 0, 0, 0);
+
+    rig.chip->contacts = 0x0010;
+    before = Registers(rig.chip);
+    TEST_ASSERT_TRUE(rig.expander->RemapRotaryEncoder(encoder, 5, 4));
+    assert_changed(before, rig.chip, 0, 0, 0, seed);
+    TEST_ASSERT_EQUAL_UINT8(5, encoder->pin1);
+    TEST_ASSERT_EQUAL_UINT8(4, encoder->pin2);
+    TEST_ASSERT_EQUAL_UINT8(1, encoder->pin1State);
+    TEST_ASSERT_EQUAL_UINT8(0, encoder->pin2State);
+    rig.chip->contacts = 0;
+}
+
+void test_remap_moves_only_the_old_and_new_pins()
+{
+    // the new pin is held down, so the button is seeded pressed
+    rig.chip->contacts = 0x0400;
+    Registers before(rig.chip);
+    TEST_ASSERT_TRUE(rig.expander->RemapButton(3, 10));
+    assert_changed(before, rig.chip, 0, 0x0408, 0x0408, removeInput + addInput + seed);
+    TEST_ASSERT_EQUAL_UINT8(LOW, rig.expander->GetButton(0)->lastState);
+    TEST_ASSERT_EQUAL_UINT8(10, rig.expander->GetButton(0)->pin);
+
+    // the encoder keeps pin 5 and moves its other pin from 4 to 11
+    rig.chip->contacts = 0x0800;
+    before = Registers(rig.chip);
+    TEST_ASSERT_TRUE(rig.expander->RemapRotaryEncoder(encoder, 5, 11));
+    assert_changed(before, rig.chip, 0, 0x0810, 0x0810, removeInput + addInput + seed);
+    TEST_ASSERT_EQUAL_UINT8(1, encoder->pin1State);
+    TEST_ASSERT_EQUAL_UINT8(0, encoder->pin2State);
+
+    // seeded from the current levels, so nothing is reported until a pin actually changes
+    GpioExpanderButtonEvent buttonEvent;
+    GpioExpanderRotaryEncoderEvent encoderEvent;
+    rig.chip->contacts = 0x0C00;
+    GpioExpanderNativeTest::Interrupt(rig.expander, 255);
+    TEST_ASSERT_FALSE(GpioExpanderReceive(xGpioExpanderButtonEventQueue, rig.expander, buttonEvent));
+    TEST_ASSERT_FALSE(GpioExpanderReceive(xGpioExpanderRotaryEncoderEventQueue, rig.expander, encoderEvent));
+    rig.chip->contacts = 0;
+}
+
+void test_remap_onto_a_pin_owned_by_another_device_is_refused()
+{
+    Registers before(rig.chip);
+    TEST_ASSERT_FALSE(rig.expander->RemapButton(10, 5));
+    TEST_ASSERT_FALSE(rig.expander->RemapRotaryEncoder(encoder, 10, 12));
+    TEST_ASSERT_FALSE(rig.expander->RemapButton(7, 12));
+    assert_changed(before, rig.chip, 0, 0, 0, 0);
+    TEST_ASSERT_EQUAL_UINT8(10, rig.expander->GetButton(0)->pin);
+    TEST_ASSERT_EQUAL_UINT8(5, encoder->pin1);
+    TEST_ASSERT_EQUAL_UINT8(11, encoder->pin2);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_init_configures_devices_added_before_it);
+    RUN_TEST(test_add_after_init_configures_only_the_new_pins);
+    RUN_TEST(test_remove_releases_only_the_removed_pins);
+    RUN_TEST(test_remap_onto_own_pins);
+    RUN_TEST(test_remap_moves_only_the_old_and_new_pins);
+    RUN_TEST(test_remap_onto_a_pin_owned_by_another_device_is_refused);
+    return UNITY_END();
+}
@@ -0,0 +1,235 @@
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+#include "../GpioExpanderNativeTest.h"
+
+// a memory sink that can record more events from inside a write, as the service task may while the log task is writing
+struct TestLogSink : public GpioExpanderMemoryLogSink
+{
+    void (*onWrite)() = nullptr;
+
+    TestLogSink(uint8_t *buffer, size_t size) : GpioExpanderMemoryLogSink(buffer, size) {}
+    size_t write(const uint8_t *data, size_t length)
+    {
+        size_t written = GpioExpanderMemoryLogSink::write(data, length);
+        if (onWrite != nullptr)
+        {
+            void (*callback)() = onWrite;
+            onWrite = nullptr;
+            callback();
+        }
+        return written;
+    }
+};
+
+static uint8_t sinkBuffer[8192];
+static TestLogSink sink(sinkBuffer, sizeof(sinkBuffer));
+
+// records carry the expander index, so keep a few initialized expanders for the whole run
+static GpioExpander *expanders[3];
+
+static const uint8_t header[] = {'G', 'X', 'L', 1};
+
+void setUp()
+{
+    GpioExpanderNativeTest::ResetEventLog();
+    sink.Clear();
+    sink.onWrite = nullptr;
+    mockMillis = 0;
+}
+
+void tearDown()
+{
+}
+
+static void assert_sink(const uint8_t *expected, size_t length)
+{
+    TEST_ASSERT_EQUAL_UINT32(length, sink.GetLength());
+    TEST_ASSERT_TRUE(memcmp(expected, sink.GetData(), length) == 0);
+}
+
+void test_start_writes_header_and_keeps_its_sink()
+{
+    TEST_ASSERT_FALSE(GpioExpanderEventLog::IsRunning());
+    TEST_ASSERT_TRUE(GpioExpanderEventLog::Start(&sink));
+    TEST_ASSERT_TRUE(GpioExpanderEventLog::IsRunning());
+    assert_sink(header, sizeof(header));
+
+    for (int i=0; i<3; i++)
+    {
+        GpioExpanderRig rig = GpioExpanderMakeRig();
+        rig.expander->Init(rig.chip, 14 + i);
+        expanders[i] = rig.expander;
+        TEST_ASSERT_EQUAL_UINT8(i, expanders[i]->GetIndex());
+    }
+
+    // nothing is recorded while stopped, and another sink cannot resume the log
+    uint8_t otherBuffer[16];
+    GpioExpanderMemoryLogSink other(otherBuffer, sizeof(otherBuffer));
+    GpioExpanderEventLog::Stop();
+    TEST_ASSERT_FALSE(GpioExpanderEventLog::Start(&other));
+    TEST_ASSERT_FALSE(GpioExpanderEventLog::IsRunning());
+    GpioExpanderEventLog::Record(GpioExpanderLogButton, expanders[0], 3, 0);
+
+    TEST_ASSERT_TRUE(GpioExpanderEventLog::Start(&sink));
+    GpioExpanderEventLog::Record(GpioExpanderLogButton, expanders[0], 4, 1);
+    sink.Clear();
+    GpioExpanderNativeTest::DrainEventLog();
+    const uint8_t expected[] = {0x10, 0x00, 0x04, 0x02};
+    assert_sink(expected, sizeof(expected));
+    TEST_ASSERT_EQUAL_UINT32(0, other.GetLength());
+}
+
+void test_encodes_every_kind()
+{
+    mockMillis = 1000;
+    GpioExpanderEventLog::Record(GpioExpanderLogButton, expanders[0], 5, 1);
+    mockMillis = 1003;
+    GpioExpanderEventLog::Record(GpioExpanderLogRotaryEncoder, expanders[1], 2, 0);
+    GpioExpanderEventLog::Record(GpioExpanderLogKeypad, expanders[0], 1 * 256 + 13, 2);
+    mockMillis = 1303;
+    GpioExpanderEventLog::Record(GpioExpanderLogCodedSwitch, expanders[1], 0, -1);
+    GpioExpanderEventLog::Record(GpioExpanderLogCodedSwitch, expanders[2], 3, -300);
+    GpioExpanderNativeTest::DrainEventLog();
+
+    const uint8_t expected[] = {
+        0x10, 0xE8, 0x07, 0x05, 0x02,   // button, expander 0, 1000ms since boot, pin 5, value 1
+        0x21, 0x03, 0x02, 0x00,         // rotary, expander 1, +3ms, encoder 2, value 0
+        0x30, 0x00, 0x8D, 0x02, 0x04,   // keypad, expander 0, +0ms, keypad 1 key 13, value 2
+        0x41, 0xAC, 0x02, 0x00, 0x01,   // switch, expander 1, +300ms, switch 0, value -1
+        0x42, 0x00, 0x03, 0xD7, 0x04,   // switch, expander 2, +0ms, switch 3, value -300
+    };
+    assert_sink(expected, sizeof(expected));
+}
+
+// the record the test expects for the nth button event recorded by fill()
+static void append_button(std::string &bytes, int n)
+{
+    bytes += (char)0x10;
+    bytes += (char)0x00;
+    bytes += (char)(n & 0x0F);
+    bytes += (char)0x00;
+}
+
+static void fill(int first, int count)
+{
+    for (int n=first; n<first+count; n++)
+    {
+        GpioExpanderEventLog::Record(GpioExpanderLogButton, expanders[0], n & 0x0F, 0);
+    }
+}
+
+static void assert_sink(const std::string &expected)
+{
+    assert_sink((const uint8_t *)expected.data(), expected.size());
+}
+
+void test_dropped_marker_follows_the_records_queued_before_it()
+{
+    // the buffer fills up and three more events are lost before the log task runs
+    fill(0, GPIOEXPANDER_EVENTLOG_CAPACITY + 3);
+    TEST_ASSERT_EQUAL_UINT32(3, GpioExpanderEventLog::GetDropped());
+    GpioExpanderNativeTest::DrainEventLog();
+
+    std::string expected;
+    for (int n=0; n<GPIOEXPANDER_EVENTLOG_CAPACITY; n++)
+    {
+        append_button(expected, n);
+    }
+    expected += std::string("\xF0\x00\x00\x06", 4);
+    assert_sink(expected);
+
+    // later events follow the marker
+    sink.Clear();
+    fill(7, 1);
+    GpioExpanderNativeTest::DrainEventLog();
+    expected.clear();
+    append_button(expected, 7);
+    assert_sink(expected);
+    TEST_ASSERT_EQUAL_UINT32(3, GpioExpanderEventLog::GetDropped());
+}
+
+void test_dropped_marker_is_carried_by_the_next_record()
+{
+    fill(0, GPIOEXPANDER_EVENTLOG_CAPACITY + 2);
+
+    // while the log task writes its first chunk, slots are free again and the service task records one more event
+    sink.onWrite = []() { fill(9, 1); };
+    GpioExpanderNativeTest::DrainEventLog();
+    GpioExpanderNativeTest::DrainEventLog();
+
+    std::string expected;
+    for (int n=0; n<GPIOEXPANDER_EVENTLOG_CAPACITY; n++)
+    {
+        append_button(expected, n);
+    }
+    expected += std::string("\xF0\x00\x00\x04", 4);
+    append_button(expected, 9);
+    assert_sink(expected);
+}
+
+static std::string test_path(const char *name)
+{
+    std::string path = __FILE__;
+    return path.substr(0, path.find_last_of("/\\") + 1) + name;
+}
+
+// golden.csv is golden.bin decoded by extras/decode_event_log.py --raw
+// replaying the decoded events must encode back to the identical capture
+void test_golden_capture_round_trips()
+{
+    FILE *file = fopen(test_path("golden.bin").c_str(), "rb");
+    TEST_ASSERT_TRUE(file != nullptr);
+    static uint8_t golden[1024];
+    size_t goldenLength = fread(golden, 1, sizeof(golden), file);
+    fclose(file);
+
+    file = fopen(test_path("golden.csv").c_str(), "r");
+    TEST_ASSERT_TRUE(file != nullptr);
+    char line[128];
+    TEST_ASSERT_TRUE(fgets(line, sizeof(line), file) != nullptr);
+    TEST_ASSERT_TRUE(strcmp(line, "time_ms,expander,kind,device,value\n") == 0);
+
+    const char *kinds[] = {"", "button", "rotary", "keypad", "switch"};
+    int events = 0;
+    while (fgets(line, sizeof(line), file) != nullptr)
+    {
+        unsigned long timeMs;
+        int expander;
+        char kind[16];
+        unsigned long device;
+        long value;
+        TEST_ASSERT_EQUAL_INT(5, sscanf(line, "%lu,%d,%15[a-z],%lu,%ld", &timeMs, &expander, kind, &device, &value));
+
+        int k = 1;
+        while (k < 5 && strcmp(kinds[k], kind) != 0)
+        {
+            k++;
+        }
+        TEST_ASSERT_TRUE(k < 5);
+
+        mockMillis = timeMs;
+        GpioExpanderEventLog::Record((GpioExpanderLogKind)k, expanders[expander], device, value);
+        events++;
+    }
+    fclose(file);
+    TEST_ASSERT_TRUE(events > 0);
+
+    sink.Clear();
+    sink.write(header, sizeof(header));
+    GpioExpanderNativeTest::DrainEventLog();
+    assert_sink(golden, goldenLength);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_start_writes_header_and_keeps_its_sink);
+    RUN_TEST(test_encodes_every_kind);
+    RUN_TEST(test_dropped_marker_follows_the_records_queued_before_it);
+    RUN_TEST(test_dropped_marker_is_carried_by_the_next_record);
+    RUN_TEST(test_golden_capture_round_trips);
+    return UNITY_END();
+}
@@ -0,0 +1,287 @@
+#include <unity.h>
+#include <chrono>
+#include <stdio.h>
+
+#include "../GpioExpanderNativeTest.h"
+
+// 4x4 keypad on port A rows and port B columns, leaving pin 7 free for an application output
+static const uint8_t rows4[] = {0, 1, 2, 3};
+static const uint8_t cols4[] = {8, 9, 10, 11};
+
+// 8x8 keypad using every pin
+static const uint8_t rows8[] = {0, 1, 2, 3, 4, 5, 6, 7};
+static const uint8_t cols8[] = {8, 9, 10, 11, 12, 13, 14, 15};
+
+void setUp()
+{
+    GpioExpanderDrainQueues();
+    mockMillis = 1000;
+}
+
+void tearDown()
+{
+}
+
+// scan once as the service task would after its wait timed out
+static void scan()
+{
+    mockMillis += 10;
+    GpioExpanderNativeTest::ServiceTimers();
+}
+
+// let go of every key and scan until the releases are confirmed
+static void releaseAll(GpioExpanderRig &rig)
+{
+    rig.chip->releaseAllKeys();
+    scan();
+    scan();
+}
+
+void test_idle_until_key_down_and_back_to_idle_after_release()
+{
+    GpioExpanderRig rig = GpioExpanderMakeRig();
+    GpioExpanderKeypad *keypad = rig.expander->AddKeypadMatrix(rows4, 4, cols4, 4);
+    rig.expander->Init(rig.chip, 14);
+
+    // rows drive low, columns are pulled up inputs with interrupts, and nothing is scheduled
+    TEST_ASSERT_EQUAL_HEX16(0x0000, rig.chip->iodir & 0x000F);
+    TEST_ASSERT_EQUAL_HEX16(0x0000, rig.chip->olat & 0x000F);
+    TEST_ASSERT_EQUAL_HEX16(0x0F00, rig.chip->gppu & 0x0F00);
+    TEST_ASSERT_EQUAL_HEX16(0x0F00, rig.chip->gpinten);
+    TEST_ASSERT_FALSE(keypad->isScanning);
+    TEST_ASSERT_EQUAL_UINT32(portMAX_DELAY, GpioExpanderNativeTest::WaitTicks());
+
+    // a key press pulls its column low and starts scanning
+    rig.chip->pressKey(2, 9);
+    GpioExpanderNativeTest::Interrupt(rig.expander, 9);
+    TEST_ASSERT_TRUE(keypad->isScanning);
+    TEST_ASSERT_EQUAL_UINT32(0, GpioExpanderNativeTest::WaitTicks());
+
+    scan();
+    GpioExpanderKeypadEvent event;
+    TEST_ASSERT_TRUE(GpioExpanderReceive(xGpioExpanderKeypadEventQueue, rig.expander, event));
+    TEST_ASSERT_EQUAL(KeyPressed, event.event);
+    TEST_ASSERT_EQUAL_UINT8(2 * 4 + 1, event.key);
+    TEST_ASSERT_EQUAL_UINT8(2, event.row);
+    TEST_ASSERT_EQUAL_UINT8(1, event.col);
+
+    // holding the key keeps scanning without repeating the event
+    scan();
+    TEST_ASSERT_FALSE(GpioExpanderReceive(xGpioExpanderKeypadEventQueue, rig.expander, event));
+    TEST_ASSERT_TRUE(keypad->isScanning);
+
+    // a release is only reported once the key has read up on two scans in a row
+    rig.chip->releaseKey(2, 9);
+    scan();
+    TEST_ASSERT_FALSE(GpioExpanderReceive(xGpioExpanderKeypadEventQueue, rig.expander, event));
+    TEST_ASSERT_TRUE(keypad->isScanning);
+    scan();
+    TEST_ASSERT_TRUE(GpioExpanderReceive(xGpioExpanderKeypadEventQueue, rig.expander, event));
+    TEST_ASSERT_EQUAL(KeyReleased, event.event);
+    TEST_ASSERT_EQUAL_UINT8(2 * 4 + 1, event.key);
+    TEST_ASSERT_FALSE(keypad->isScanning);
+    TEST_ASSERT_EQUAL_UINT32(portMAX_DELAY, GpioExpanderNativeTest::WaitTicks());
+    TEST_ASSERT_EQUAL_HEX16(0x0000, rig.chip->iodir & 0x000F);
+}
+
+void test_rollover_with_diodes()
+{
+    GpioExpanderRig rig = GpioExpanderMakeRig();
+    rig.chip->diodes = true;
+    rig.expander->AddKeypadMatrix(rows4, 4, cols4, 4, 10, true);
+    rig.expander->Init(rig.chip, 14);
+
+    // a rectangle of keys plus one more, which would ghost without diodes
+    rig.chip->pressKey(0, 8);
+    rig.chip->pressKey(0, 9);
+    rig.chip->pressKey(1, 8);
+    rig.chip->pressKey(1, 9);
+    rig.chip->pressKey(3, 11);
+    GpioExpanderNativeTest::Interrupt(rig.expander, 8);
+    scan();
+
+    uint64_t pressed = 0;
+    GpioExpanderKeypadEvent event;
+    while (GpioExpanderReceive(xGpioExpanderKeypadEventQueue, rig.expander, event))
+    {
+        TEST_ASSERT_EQUAL(KeyPressed, event.event);
+        pressed |= 1ULL << event.key;
+    }
+    TEST_ASSERT_TRUE(pressed == ((1ULL << 0) | (1ULL << 1) | (1ULL << 4) | (1ULL << 5) | (1ULL << 15)));
+
+    releaseAll(rig);
+}
+
+void test_ghosting_without_diodes()
+{
+    GpioExpanderRig rig = GpioExpanderMakeRig();
+    GpioExpanderKeypad *keypad = rig.expander->AddKeypadMatrix(rows4, 4, cols4, 4);
+    rig.expander->Init(rig.chip, 14);
+    GpioExpanderKeypadEvent event;
+
+    // two keys in one row roll over normally
+    rig.chip->pressKey(0, 8);
+    GpioExpanderNativeTest::Interrupt(rig.expander, 8);
+    scan();
+    rig.chip->pressKey(0, 9);
+    scan();
+    TEST_ASSERT_TRUE(GpioExpanderReceive(xGpioExpanderKeypadEventQueue, rig.expander, event));
+    TEST_ASSERT_EQUAL_UINT8(0, event.key);
+    TEST_ASSERT_TRUE(GpioExpanderReceive(xGpioExpanderKeypadEventQueue, rig.expander, event));
+    TEST_ASSERT_EQUAL_UINT8(1, event.key);
+
+    // a third corner makes the fourth (row 1, column 9) read as pressed through the other three
+    rig.chip->pressKey(1, 8);
+    scan();
+    TEST_ASSERT_TRUE(GpioExpanderReceive(xGpioExpanderKeypadEventQueue, rig.expander, event));
+    TEST_ASSERT_EQUAL(KeyGhosted, event.event);
+    TEST_ASSERT_FALSE(GpioExpanderReceive(xGpioExpanderKeypadEventQueue, rig.expander, event));
+    TEST_ASSERT_TRUE(keypad->isGhosted);
+    TEST_ASSERT_TRUE(keypad->keys == ((1ULL << 0) | (1ULL << 1)));
+
+    // once the third key is released the held keys are unchanged and nothing is reported
+    rig.chip->releaseKey(1, 8);
+    scan();
+    TEST_ASSERT_FALSE(GpioExpanderReceive(xGpioExpanderKeypadEventQueue, rig.expander, event));
+    TEST_ASSERT_FALSE(keypad->isGhosted);
+
+    releaseAll(rig);
+}
+
+void test_rows_never_drive_against_each_other_without_diodes()
+{
+    GpioExpanderRig rig = GpioExpanderMakeRig();
+    rig.expander->AddKeypadMatrix(rows4, 4, cols4, 4);
+    rig.expander->Init(rig.chip, 14);
+
+    // two keys in one column join row 0 and row 1; driving one high while the other is low would short them
+    rig.chip->pressKey(0, 10);
+    rig.chip->pressKey(1, 10);
+    GpioExpanderNativeTest::Interrupt(rig.expander, 10);
+    scan();
+    scan();
+    TEST_ASSERT_FALSE(rig.chip->shorted);
+
+    uint64_t pressed = 0;
+    GpioExpanderKeypadEvent event;
+    while (GpioExpanderReceive(xGpioExpanderKeypadEventQueue, rig.expander, event))
+    {
+        pressed |= 1ULL << event.key;
+    }
+    TEST_ASSERT_TRUE(pressed == ((1ULL << 2) | (1ULL << 6)));
+
+    releaseAll(rig);
+}
+
+void test_scan_keeps_application_outputs()
+{
+    GpioExpanderRig rig = GpioExpanderMakeRig();
+    rig.chip->diodes = true;
+    rig.expander->AddKeypadMatrix(rows4, 4, cols4, 4, 10, true);
+    rig.expander->Init(rig.chip, 14);
+
+    // the application drives an LED on a free pin of the same expander
+    rig.chip->pinMode(7, OUTPUT);
+    rig.chip->digitalWrite(7, HIGH);
+
+    rig.chip->pressKey(1, 11);
+    GpioExpanderNativeTest::Interrupt(rig.expander, 11);
+    scan();
+    TEST_ASSERT_EQUAL_HEX16(0x0080, rig.chip->olat & 0x0080);
+
+    // the application turns the LED off from its own task while a scan is under way
+    static int reads;
+    reads = 0;
+    rig.chip->beforeRead = [](Adafruit_MCP23X17 &chip) { if (++reads == 3) { chip.digitalWrite(7, LOW); } };
+    scan();
+    rig.chip->beforeRead = nullptr;
+    TEST_ASSERT_TRUE(reads > 3);
+    TEST_ASSERT_EQUAL_HEX16(0x0000, rig.chip->olat & 0x0080);
+
+    releaseAll(rig);
+    TEST_ASSERT_EQUAL_HEX16(0x0000, rig.chip->olat & 0x0080);
+    TEST_ASSERT_EQUAL_HEX16(0x0000, rig.chip->olat & 0x000F);
+}
+
+void test_release_bounce_is_not_reported()
+{
+    GpioExpanderRig rig = GpioExpanderMakeRig();
+    GpioExpanderKeypad *keypad = rig.expander->AddKeypadMatrix(rows4, 4, cols4, 4);
+    rig.expander->Init(rig.chip, 14);
+    GpioExpanderKeypadEvent event;
+
+    rig.chip->pressKey(2, 9);
+    GpioExpanderNativeTest::Interrupt(rig.expander, 9);
+    scan();
+    TEST_ASSERT_TRUE(GpioExpanderReceive(xGpioExpanderKeypadEventQueue, rig.expander, event));
+    TEST_ASSERT_EQUAL(KeyPressed, event.event);
+
+    // the contact opens, bounces closed for the next scan, then opens for good
+    rig.chip->releaseKey(2, 9);
+    scan();
+    rig.chip->pressKey(2, 9);
+    scan();
+    rig.chip->releaseKey(2, 9);
+    scan();
+    TEST_ASSERT_FALSE(GpioExpanderReceive(xGpioExpanderKeypadEventQueue, rig.expander, event));
+    TEST_ASSERT_TRUE(keypad->isScanning);
+
+    scan();
+    TEST_ASSERT_TRUE(GpioExpanderReceive(xGpioExpanderKeypadEventQueue, rig.expander, event));
+    TEST_ASSERT_EQUAL(KeyReleased, event.event);
+    TEST_ASSERT_FALSE(GpioExpanderReceive(xGpioExpanderKeypadEventQueue, rig.expander, event));
+    TEST_ASSERT_FALSE(keypad->isScanning);
+    TEST_ASSERT_EQUAL_UINT32(portMAX_DELAY, GpioExpanderNativeTest::WaitTicks());
+}
+
+// report the scan rate of an 8x8 keypad on the host and the rate the I2C bus allows on the target
+static unsigned long measure_scan(bool hasDiodes, const char *name)
+{
+    GpioExpanderRig rig = GpioExpanderMakeRig();
+    rig.chip->diodes = hasDiodes;
+    GpioExpanderKeypad *keypad = rig.expander->AddKeypadMatrix(rows8, 8, cols8, 8, 10, hasDiodes);
+    rig.expander->Init(rig.chip, 14);
+    rig.chip->pressKey(5, 12);
+
+    const int scans = 1000;
+    unsigned long before = rig.chip->busTransactions;
+    auto start = std::chrono::steady_clock::now();
+    for (int i=0; i<scans; i++)
+    {
+        TEST_ASSERT_TRUE(GpioExpanderNativeTest::ScanKeypad(rig.expander, keypad) == (1ULL << (5 * 8 + 4)));
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    unsigned long transactions = (rig.chip->busTransactions - before) / scans;
+
+    // a register transaction at 400kHz is about 5 bytes of 9 bits
+    double busScansPerSecond = 1.0 / (transactions * 5 * 9 / 400000.0);
+    char message[160];
+    snprintf(message, sizeof(message), "8x8 %s: %lu bus transactions per scan, %.0f scans/s on host, ~%.0f scans/s at 400kHz I2C",
+        name, transactions, scans / seconds, busScansPerSecond);
+    TEST_MESSAGE(message);
+
+    rig.chip->releaseAllKeys();
+    return transactions;
+}
+
+void test_scan_rate()
+{
+    // with diodes: one read for the starting levels, a latch write and a read per row, and one write to go idle
+    TEST_ASSERT_EQUAL_UINT32(1 + 8 * 2 + 1, measure_scan(true, "with diodes"));
+
+    // without diodes rows are released and driven through IODIR, each a pinMode (two read-modify-writes)
+    TEST_ASSERT_EQUAL_UINT32((7 + 7 * 2 + 7) * 4 + 8, measure_scan(false, "without diodes"));
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_idle_until_key_down_and_back_to_idle_after_release);
+    RUN_TEST(test_rollover_with_diodes);
+    RUN_TEST(test_ghosting_without_diodes);
+    RUN_TEST(test_rows_never_drive_against_each_other_without_diodes);
+    RUN_TEST(test_scan_keeps_application_outputs);
+    RUN_TEST(test_release_bounce_is_not_reported);
+    RUN_TEST(test_scan_rate);
+    return UNITY_END();
+}
@@ -1,10 +1,9 @@
 #include <Arduino.h>
 
-// debug macro to enable flashing BUILTIN_LED on button events
-#define GPIOEXPANDERBUTTONS_FLASH_BUILTIN_LED TRUE
+// to flash BUILTIN_LED on button events, build the library with -DGPIOEXPANDERBUTTONS_FLASH_BUILTIN_LED=TRUE
 
 #include <Adafruit_MCP23X17.h>
-#include "GpioExpanderButtons.h"
+#include <GpioExpanderLib.h>
 
 // Pins for interrupt
 #define EXPANDER_INT_PIN 14      // microcontroller pin attached to INTA/B
@@ -4,11 +4,10 @@
 // also needed is to instantiate multiple instances of the GpioExpanderButtons class.
 // the button event will have a pointer to the class that initiated the button press event.
 
-// debug macro to enable flashing BUILTIN_LED on button events
-#define GPIOEXPANDERBUTTONS_FLASH_BUILTIN_LED TRUE
+// to flash BUILTIN_LED on button events, build the library with -DGPIOEXPANDERBUTTONS_FLASH_BUILTIN_LED=TRUE
 
 #include <Adafruit_MCP23X17.h>
-#include "GpioExpanderButtons.h"
+#include <GpioExpanderLib.h>
 
 // Pins for interrupt
 #define EXPANDER1_INT_PIN 14
@@ -0,0 +1,61 @@
+#include <Arduino.h>
+// This is an example of a 4x4 matrix keypad on a single MCP23017
+// the rows are held low and the columns raise interrupts, so the keypad is only scanned while a key is held down.
+// this keypad has no diodes: the rows that are not being scanned are released to inputs so that two pressed keys
+// in one column never short two outputs, and key combinations that would ghost are reported as KeyGhosted.
+// if every key on your keypad has a diode (cathode towards the row), pass hasDiodes = true to AddKeypadMatrix for a
+// faster scan through the output latch with full n-key rollover.  Do not do this for a keypad without diodes.
+
+#include <Adafruit_MCP23X17.h>
+#include <GpioExpanderLib.h>
+
+// Pins for interrupt
+#define EXPANDER_INT_PIN 14      // microcontroller pin attached to INTA/B
+
+// keypad wiring on the expander
+const uint8_t keypadRows[] = {0, 1, 2, 3};
+const uint8_t keypadCols[] = {8, 9, 10, 11};
+const char keypadKeys[] = "123A456B789C*0#D";
+
+// global variables for GPIO expander
+Adafruit_MCP23X17 mcp;
+GpioExpander expander;
+
+void setup() 
+{
+  Serial.begin(115200);
+
+  // initialize the MCP23x17 chip
+  if (!mcp.begin_I2C()) 
+  {
+    Serial.println("Error connecting to MCP23017 module.  Stopping.");
+    while (1);
+  }
+
+  // initialize the library with the keypad
+  expander.AddKeypadMatrix(keypadRows, 4, keypadCols, 4);
+  expander.Init(&mcp, EXPANDER_INT_PIN);
+}
+
+void loop() 
+{
+  // process all pending keypad events in the queue
+  while (uxQueueMessagesWaiting(xGpioExpanderKeypadEventQueue))
+  {
+    // retrieve the event from the queue and obtain the key info
+    GpioExpanderKeypadEvent event;
+    xQueueReceive(xGpioExpanderKeypadEventQueue, &event, portMAX_DELAY);
+
+    // dump the event details
+    if (event.event == KeyGhosted)
+    {
+      Serial.println("too many keys held to tell them apart");
+    }
+    else
+    {
+      Serial.print ("key ");
+      Serial.print (keypadKeys[event.key]);
+      Serial.println (event.event == KeyPressed ? " pressed" : " released");
+    }
+  }
+}
@@ -0,0 +1,101 @@
+#!/usr/bin/env python3
+"""Decode a binary event log captured with GpioExpanderEventLog.
+
+Reads the stream from a file (or stdin) and prints one CSV line per event:
+    time_ms,expander,kind,device,value
+
+The output can be replayed into host tests or loaded into a spreadsheet.
+See src/GpioExpanderEventLog.h for the stream format.
+"""
+
+import argparse
+import sys
+
+HEADER = b"GXL\x01"
+
+KINDS = {
+    1: "button",
+    2: "rotary",
+    3: "keypad",
+    4: "switch",
+    15: "dropped",
+}
+
+EVENTS = {
+    "button": ["pressed", "released"],
+    "rotary": ["still", "clockwise", "counterclockwise"],
+    "keypad": ["pressed", "released", "ghosted"],
+}
+
+
+def read_varint(data, offset):
+    value = 0
+    shift = 0
+    while True:
+        if offset >= len(data):
+            raise EOFError("truncated record")
+        byte = data[offset]
+        offset += 1
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if byte < 0x80:
+            return value, offset
+
+
+def decode(data):
+    """Yield (time_ms, expander, kind, device, value) tuples from a log stream."""
+    if not data.startswith(HEADER):
+        raise ValueError("not a GpioExpander event log (bad header)")
+
+    offset = len(HEADER)
+    time_ms = 0
+    while offset < len(data):
+        start = offset
+        try:
+            head = data[offset]
+            offset += 1
+            delta, offset = read_varint(data, offset)
+            device, offset = read_varint(data, offset)
+            zigzag, offset = read_varint(data, offset)
+        except EOFError:
+            # the capture stopped part way through a record
+            print("warning: ignoring %d trailing bytes" % (len(data) - start), file=sys.stderr)
+            return
+
+        time_ms += delta
+        kind = KINDS.get(head >> 4, "unknown%d" % (head >> 4))
+        value = (zigzag >> 1) ^ -(zigzag & 1)
+        yield time_ms, head & 0x0F, kind, device, value
+
+
+def format_event(kind, device, value, raw):
+    if raw:
+        return str(device), str(value)
+    if kind == "keypad":
+        device = "%d:%s" % (device >> 8, "-" if device & 0xFF == 0xFF else device & 0xFF)
+    names = EVENTS.get(kind)
+    if names and 0 <= value < len(names):
+        value = names[value]
+    return str(device), str(value)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("log", nargs="?", help="binary log file (default: stdin)")
+    parser.add_argument("--raw", action="store_true", help="print numeric device ids and values")
+    args = parser.parse_args()
+
+    if args.log:
+        with open(args.log, "rb") as stream:
+            data = stream.read()
+    else:
+        data = sys.stdin.buffer.read()
+
+    print("time_ms,expander,kind,device,value")
+    for time_ms, expander, kind, device, value in decode(data):
+        device, value = format_event(kind, device, value, args.raw)
+        print("%d,%d,%s,%s,%s" % (time_ms, expander, kind, device, value))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,68 @@
+#include "GpioExpanderLib.h"
+
+QueueHandle_t xGpioExpanderButtonEventQueue = nullptr;
+
+void GpioExpanderButtonHandler(GpioExpander* expander, uint16_t pin, GpioExpanderButton* device, uint16_t state) 
+{
+
+#if defined(GPIOEXPANDERBUTTONS_FLASH_BUILTIN_LED) && GPIOEXPANDERBUTTONS_FLASH_BUILTIN_LED == TRUE
+    // flash the LED in debug mode
+    digitalWrite(LED_BUILTIN, HIGH);
+#endif
+    unsigned long now = millis();
+    bool track = false;
+    
+    // check if this is a change and if the change needs to be debounced
+    if (device->lastState != state )
+    {
+        // the state has changed
+        if (now - device->lastStateChange < 20)
+        {
+            // this is too fast.  Ignore
+            #ifdef GPIOEXPANDERLIB_PRINT_DEBUG
+            Serial.print("debounce ");
+            Serial.println (state);
+            #endif
+            device->lastStateChange = now;
+            return;
+        }
+    }
+    else
+    {
+        // no change, return
+        #ifdef GPIOEXPANDERLIB_PRINT_DEBUG
+        Serial.print ("no change ");
+        Serial.println (state);
+        #endif
+        return;
+    }
+    // check the mode for this device
+    if ((device->mode == LOW || device->mode == CHANGE) && state == LOW)
+    {
+        track = true;
+    }
+    else if ((device->mode == HIGH || device->mode == CHANGE) && state == HIGH)
+    {
+        track = true;
+    }
+    // check if this is a button press (versus a release)
+    if (track)
+    {
+        GpioExpanderButtonEvent event;
+        event.expander = expander;
+        event.pin = pin;
+        event.event = (state == LOW)?Pressed: Released;
+
+        // send a button press to the queue
+        GpioExpanderPublishEvent(xGpioExpanderButtonEventQueue, &event, sizeof(event));
+        GpioExpanderEventLog::Record(GpioExpanderLogButton, expander, pin, event.event);
+    }
+
+    device->lastState = state;
+    device->lastStateChange = now;
+
+#if defined(GPIOEXPANDERBUTTONS_FLASH_BUILTIN_LED) && GPIOEXPANDERBUTTONS_FLASH_BUILTIN_LED == TRUE
+    // clear the LED flash in debug mode
+    digitalWrite(LED_BUILTIN, LOW);
+#endif
+}
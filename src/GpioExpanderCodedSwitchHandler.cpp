@@ -0,0 +1,140 @@
+#include "GpioExpanderLib.h"
+
+QueueHandle_t xGpioExpanderCodedSwitchEventQueue = nullptr;
+
+// turn a snapshot of all the expander pins into the switch position
+// returns GPIOEXPANDER_CODEDSWITCH_INVALID for codes the encoding cannot produce, such as a BCD digit above 9
+int16_t GpioExpanderCodedSwitchDecode(GpioExpanderCodedSwitch* device, uint16_t allPins)
+{
+    uint16_t code = 0;
+    for (uint8_t i=0; i<device->pinCount; i++)
+    {
+        if (GPIOEXPANDERBUTTONS_PIN_PRESSED(allPins, device->pins[i]))
+        {
+            code |= GPIOEXPANDERBUTTONS_PIN(i);
+        }
+    }
+
+    switch (device->encoding)
+    {
+        case CodedBinary:
+            return code;
+
+        case CodedGray:
+        {
+            // each binary bit is the xor of all the gray bits at or above it
+            uint16_t value = code;
+            for (uint16_t shifted = code >> 1; shifted != 0; shifted >>= 1)
+            {
+                value ^= shifted;
+            }
+            return value;
+        }
+
+        case CodedBcd:
+        {
+            int16_t value = 0;
+            int16_t scale = 1;
+            for (uint8_t bit=0; bit<device->pinCount; bit+=4, scale*=10)
+            {
+                uint8_t digit = (code >> bit) & 0x0F;
+                if (digit > 9)
+                {
+                    return GPIOEXPANDER_CODEDSWITCH_INVALID;
+                }
+                value += digit * scale;
+            }
+            return value;
+        }
+
+        case CodedOneHot:
+        {
+            // exactly one contact must be closed; none or several happen while the wiper is between positions
+            if (code == 0 || (code & (code - 1)) != 0)
+            {
+                return GPIOEXPANDER_CODEDSWITCH_INVALID;
+            }
+            int16_t position = 0;
+            while ((code >>= 1) != 0)
+            {
+                position++;
+            }
+            return position;
+        }
+    }
+
+    return GPIOEXPANDER_CODEDSWITCH_INVALID;
+}
+
+// track a new snapshot of the switch pins
+// any change starts the settle timer, and transitional codes seen while the switch moves are dropped
+// an invalid code also settles, as the interrupt for the final position may already have been captured
+void GpioExpanderCodedSwitchHandler(GpioExpander* expander, GpioExpanderCodedSwitch* device, uint16_t allPins)
+{
+    unsigned long now = millis();
+    int16_t value = GpioExpanderCodedSwitchDecode(device, allPins);
+
+    if (value == device->value)
+    {
+        // bounced back to where it was.  Nothing to report
+        device->isSettling = false;
+    }
+    else if (!device->isSettling || value != device->pendingValue)
+    {
+        // a new position or a code between positions.  Confirm it with a fresh read once the settle time has passed
+        device->pendingValue = value;
+        device->pendingSinceMs = now;
+        device->isSettling = true;
+    }
+
+    #ifdef GPIOEXPANDERLIB_PRINT_DEBUG
+    Serial.print("switch ");
+    Serial.print(device->index);
+    Serial.print(": ");
+    Serial.print(value);
+    Serial.println(device->isSettling ? " settling" : " ignored");
+    #endif
+}
+
+// called by the service task once the settle time has passed
+// the position is confirmed against a fresh read, as changes made while the interrupt was pending are not captured
+void GpioExpanderCodedSwitchSettle(GpioExpander* expander, GpioExpanderCodedSwitch* device, uint16_t allPins)
+{
+    if (GpioExpanderCodedSwitchDecode(device, allPins) != device->pendingValue)
+    {
+        // the switch moved on, so treat this as a new snapshot
+        GpioExpanderCodedSwitchHandler(expander, device, allPins);
+        return;
+    }
+
+    if (device->pendingValue == GPIOEXPANDER_CODEDSWITCH_INVALID)
+    {
+        // still between positions, there is nothing to report until the switch moves again
+        device->isSettling = false;
+        return;
+    }
+
+#if defined(GPIOEXPANDERBUTTONS_FLASH_BUILTIN_LED) && GPIOEXPANDERBUTTONS_FLASH_BUILTIN_LED == TRUE
+    // flash the LED in debug mode
+    digitalWrite(LED_BUILTIN, HIGH);
+#endif
+
+    GpioExpanderCodedSwitchEvent event;
+    event.value = device->pendingValue;
+    event.previousValue = device->value;
+    event.expander = expander;
+    event.device = device;
+    event.eventMillis = millis();
+
+    device->value = device->pendingValue;
+    device->isSettling = false;
+
+    // send the new position to the queue
+    GpioExpanderPublishEvent(xGpioExpanderCodedSwitchEventQueue, &event, sizeof(event));
+    GpioExpanderEventLog::Record(GpioExpanderLogCodedSwitch, expander, device->index, event.value);
+
+#if defined(GPIOEXPANDERBUTTONS_FLASH_BUILTIN_LED) && GPIOEXPANDERBUTTONS_FLASH_BUILTIN_LED == TRUE
+    // clear the LED flash in debug mode
+    digitalWrite(LED_BUILTIN, LOW);
+#endif
+}
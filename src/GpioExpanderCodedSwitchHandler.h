@@ -0,0 +1,20 @@
+#ifndef GPIOEXPANDERCODEDSWITCHHANDLER_H
+#define GPIOEXPANDERCODEDSWITCHHANDLER_H
+
+// queue of coded switch events published by the service task, created by the first GpioExpander::Init()
+extern QueueHandle_t xGpioExpanderCodedSwitchEventQueue;
+
+struct GpioExpanderCodedSwitchEvent
+{
+    int16_t value;
+    int16_t previousValue;  // GPIOEXPANDER_CODEDSWITCH_INVALID if the switch had no valid position before
+    GpioExpander* expander;
+    GpioExpanderCodedSwitch* device;
+    unsigned long eventMillis;
+};
+
+int16_t GpioExpanderCodedSwitchDecode(GpioExpanderCodedSwitch* device, uint16_t allPins);
+void GpioExpanderCodedSwitchHandler(GpioExpander* expander, GpioExpanderCodedSwitch* device, uint16_t allPins);
+void GpioExpanderCodedSwitchSettle(GpioExpander* expander, GpioExpanderCodedSwitch* device, uint16_t allPins);
+
+#endif //GPIOEXPANDERCODEDSWITCHHANDLER_H
@@ -0,0 +1,26 @@
+#ifndef GPIOEXPANDERCODEDSWITCHTYPES_H
+#define GPIOEXPANDERCODEDSWITCHTYPES_H
+
+#define GPIOEXPANDER_CODEDSWITCH_MAX_PINS 8
+#define GPIOEXPANDER_CODEDSWITCH_INVALID -1
+
+// how the pins of a switch encode its position, pins[0] is the least significant bit
+// contacts are active low, so a pin pulled to ground reads as a 1
+enum GpioExpanderCodedSwitchEncoding {CodedBinary, CodedGray, CodedBcd, CodedOneHot};
+
+struct GpioExpanderCodedSwitch
+{
+    bool isUsed = false;
+    uint8_t pinCount = 0;
+    uint8_t pins[GPIOEXPANDER_CODEDSWITCH_MAX_PINS];
+    uint16_t pinMask = 0;
+    GpioExpanderCodedSwitchEncoding encoding = CodedBinary;
+    unsigned long settleMs = 20;
+    int16_t value = GPIOEXPANDER_CODEDSWITCH_INVALID;           // last reported position
+    int16_t pendingValue = GPIOEXPANDER_CODEDSWITCH_INVALID;    // position waiting out the settle time
+    unsigned long pendingSinceMs = 0;
+    bool isSettling = false;
+    uint8_t index = 255;
+};
+
+#endif //GPIOEXPANDERCODEDSWITCHTYPES_H
@@ -0,0 +1,215 @@
+#include "GpioExpanderLib.h"
+
+#include <atomic>
+
+#if (GPIOEXPANDER_EVENTLOG_CAPACITY & (GPIOEXPANDER_EVENTLOG_CAPACITY - 1)) != 0 || GPIOEXPANDER_EVENTLOG_CAPACITY > 32768
+#error GPIOEXPANDER_EVENTLOG_CAPACITY must be a power of two no larger than 32768
+#endif
+
+// an event as captured on the hot path, before encoding
+struct GpioExpanderLogRecord
+{
+    unsigned long eventMillis;
+    uint32_t device;
+    int32_t value;
+    uint32_t droppedBefore;     // records lost between the previous record and this one
+    uint8_t kind;
+    uint8_t expanderIndex;
+};
+
+// single producer (the service task) / single consumer (the log task) ring buffer
+// the producer only moves head and the consumer only moves tail, so neither side ever blocks the other
+static GpioExpanderLogRecord GpioExpanderLogRecords[GPIOEXPANDER_EVENTLOG_CAPACITY];
+static std::atomic<uint16_t> GpioExpanderLogHead(0);
+static std::atomic<uint16_t> GpioExpanderLogTail(0);
+static std::atomic<uint32_t> GpioExpanderLogDroppedCount(0);
+static std::atomic<uint32_t> GpioExpanderLogPendingDropped(0);
+static std::atomic<bool> GpioExpanderLogRunning(false);
+
+static GpioExpanderLogSink *GpioExpanderLogOutput = nullptr;
+static TaskHandle_t xGpioExpanderLogTaskToNotify = nullptr;
+
+// only touched by the log task
+static unsigned long GpioExpanderLogLastMillis = 0;
+
+static const uint8_t GpioExpanderLogHeader[] = {'G', 'X', 'L', 1};
+
+size_t GpioExpanderMemoryLogSink::write(const uint8_t *data, size_t length)
+{
+    if (_length + length > _size)
+    {
+        // keep the records captured so far intact rather than storing a partial one
+        _overflowed = true;
+        return 0;
+    }
+
+    memcpy(_buffer + _length, data, length);
+    _length += length;
+    return length;
+}
+
+// start recording to the sink
+// the sink is fixed by the first call, later calls only resume recording after Stop()
+bool GpioExpanderEventLog::Start(GpioExpanderLogSink *sink, UBaseType_t priority)
+{
+    if (xGpioExpanderLogTaskToNotify != nullptr)
+    {
+        // a different sink is refused without resuming the recording to the original one
+        if (sink != GpioExpanderLogOutput)
+        {
+            return false;
+        }
+        GpioExpanderLogRunning = true;
+        return true;
+    }
+
+    if (sink == nullptr)
+    {
+        return false;
+    }
+
+    GpioExpanderLogOutput = sink;
+    GpioExpanderLogOutput->write(GpioExpanderLogHeader, sizeof(GpioExpanderLogHeader));
+
+    // the log task only runs after events were recorded, so it adds no wakes while the inputs are idle
+    xTaskCreate(
+            GpioExpanderEventLog::GpioExpanderEventLogTask,  // Function to be called
+            "GpioExpander Event Log",   // Name of task
+            2048,         // Stack size (bytes in ESP32, words in FreeRTOS)
+            NULL,         // Parameter to pass to function
+            priority,     // Task priority (0 to configMAX_PRIORITIES - 1)
+            &xGpioExpanderLogTaskToNotify);         // Task handle
+
+    GpioExpanderLogRunning = true;
+    return true;
+}
+
+// stop recording new events, anything already buffered is still written to the sink
+void GpioExpanderEventLog::Stop()
+{
+    GpioExpanderLogRunning = false;
+}
+
+bool GpioExpanderEventLog::IsRunning()
+{
+    return GpioExpanderLogRunning;
+}
+
+// total number of records lost because the log task could not keep up
+uint32_t GpioExpanderEventLog::GetDropped()
+{
+    return GpioExpanderLogDroppedCount;
+}
+
+// called from the handlers on the service task; never blocks and never touches the sink
+void GpioExpanderEventLog::Record(GpioExpanderLogKind kind, GpioExpander *expander, uint32_t device, int32_t value)
+{
+    if (!GpioExpanderLogRunning.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+
+    uint16_t head = GpioExpanderLogHead.load(std::memory_order_relaxed);
+    uint16_t tail = GpioExpanderLogTail.load(std::memory_order_acquire);
+    if ((uint16_t)(head - tail) >= GPIOEXPANDER_EVENTLOG_CAPACITY)
+    {
+        // the buffer is full.  Drop the record rather than stall input handling
+        GpioExpanderLogDroppedCount++;
+        GpioExpanderLogPendingDropped++;
+        return;
+    }
+
+    GpioExpanderLogRecord &record = GpioExpanderLogRecords[head & (GPIOEXPANDER_EVENTLOG_CAPACITY - 1)];
+    record.eventMillis = millis();
+    record.device = device;
+    record.value = value;
+    record.kind = kind;
+    record.expanderIndex = expander->GetIndex();
+    record.droppedBefore = GpioExpanderLogPendingDropped.exchange(0);
+    GpioExpanderLogHead.store(head + 1, std::memory_order_release);
+
+    xTaskNotifyGive(xGpioExpanderLogTaskToNotify);
+}
+
+// encode one record into data, which must have room for 1 + 5 + 5 + 5 bytes
+size_t GpioExpanderEventLog::Encode(uint8_t *data, uint8_t kind, uint8_t expanderIndex, uint32_t deltaMs, uint32_t device, int32_t value)
+{
+    size_t length = 0;
+    uint32_t fields[3] = {deltaMs, device, ((uint32_t)value << 1) ^ (uint32_t)(value >> 31)};
+
+    data[length++] = (kind << 4) | (expanderIndex & 0x0F);
+
+    // base 128 varints, least significant group first
+    for (int i=0; i<3; i++)
+    {
+        uint32_t field = fields[i];
+        while (field >= 0x80)
+        {
+            data[length++] = (field & 0x7F) | 0x80;
+            field >>= 7;
+        }
+        data[length++] = field;
+    }
+
+    return length;
+}
+
+// encode everything recorded so far and write it to the sink
+void GpioExpanderEventLog::Drain()
+{
+    uint8_t buffer[128];
+    size_t length = 0;
+    uint16_t tail = GpioExpanderLogTail.load(std::memory_order_relaxed);
+    uint16_t head = GpioExpanderLogHead.load(std::memory_order_acquire);
+
+    while (tail != head)
+    {
+        const GpioExpanderLogRecord &record = GpioExpanderLogRecords[tail & (GPIOEXPANDER_EVENTLOG_CAPACITY - 1)];
+
+        // mark the gap where records were lost, after the records that were queued before it
+        if (record.droppedBefore > 0)
+        {
+            length += Encode(buffer + length, GpioExpanderLogDropped, 0, 0, 0, record.droppedBefore);
+        }
+        length += Encode(buffer + length, record.kind, record.expanderIndex, record.eventMillis - GpioExpanderLogLastMillis, record.device, record.value);
+        GpioExpanderLogLastMillis = record.eventMillis;
+
+        // hand the slot back to the producer as soon as it has been encoded
+        tail++;
+        GpioExpanderLogTail.store(tail, std::memory_order_release);
+
+        // leave room for a dropped marker and a record, and for the trailing marker after the loop
+        if (length > sizeof(buffer) - 32)
+        {
+            GpioExpanderLogOutput->write(buffer, length);
+            length = 0;
+        }
+    }
+
+    // records lost after the last one recorded so far have no later record to carry them
+    // nothing can be dropped while the buffer is empty, so they all follow the records written above
+    if (GpioExpanderLogHead.load(std::memory_order_acquire) == tail)
+    {
+        uint32_t dropped = GpioExpanderLogPendingDropped.exchange(0);
+        if (dropped > 0)
+        {
+            length += Encode(buffer + length, GpioExpanderLogDropped, 0, 0, 0, dropped);
+        }
+    }
+
+    if (length > 0)
+    {
+        GpioExpanderLogOutput->write(buffer, length);
+    }
+    GpioExpanderLogOutput->flush();
+}
+
+void GpioExpanderEventLog::GpioExpanderEventLogTask(void *parameter)
+{
+    while(1)
+    {
+        // wait for the service task to record something
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        Drain();
+    }
+}
@@ -0,0 +1,80 @@
+#ifndef GPIOEXPANDEREVENTLOG_H
+#define GPIOEXPANDEREVENTLOG_H
+
+// capacity of the buffer between the service task and the log task, in records (must be a power of two)
+#ifndef GPIOEXPANDER_EVENTLOG_CAPACITY
+#define GPIOEXPANDER_EVENTLOG_CAPACITY 256
+#endif
+
+// the kind of device that produced a logged event, stored in the top nibble of each record
+enum GpioExpanderLogKind
+{
+    GpioExpanderLogButton = 1,          // device is the pin, value is the GpioExpanderButtonEventEnum
+    GpioExpanderLogRotaryEncoder = 2,   // device is the encoder index, value is the GpioExpanderRotaryEncoderEventEnum
+    GpioExpanderLogKeypad = 3,          // device is keypad index * 256 + key, value is the GpioExpanderKeypadEventEnum
+    GpioExpanderLogCodedSwitch = 4,     // device is the switch index, value is the new position
+    GpioExpanderLogDropped = 15         // device is 0, value is the number of records lost because the buffer was full
+};
+
+// destination for the encoded log stream
+class GpioExpanderLogSink
+{
+    public:
+        virtual ~GpioExpanderLogSink() {}
+        virtual size_t write(const uint8_t *data, size_t length) = 0;
+        virtual void flush() {}
+};
+
+// writes the log to anything that is a Print, such as Serial or an open File
+class GpioExpanderPrintLogSink : public GpioExpanderLogSink
+{
+    private:
+        Print &_output;
+
+    public:
+        GpioExpanderPrintLogSink(Print &output) : _output(output) {}
+        size_t write(const uint8_t *data, size_t length) { return _output.write(data, length); }
+};
+
+// captures the log into a caller supplied buffer, stopping once it is full
+class GpioExpanderMemoryLogSink : public GpioExpanderLogSink
+{
+    private:
+        uint8_t *_buffer;
+        size_t _size;
+        size_t _length;
+        bool _overflowed;
+
+    public:
+        GpioExpanderMemoryLogSink(uint8_t *buffer, size_t size) : _buffer(buffer), _size(size), _length(0), _overflowed(false) {}
+        size_t write(const uint8_t *data, size_t length);
+        const uint8_t *GetData() { return _buffer; }
+        size_t GetLength() { return _length; }
+        bool HasOverflowed() { return _overflowed; }
+        void Clear() { _length = 0; _overflowed = false; }
+};
+
+// compact binary record of every input event across all expanders
+// the service task only copies a fixed size record into a lock-free buffer; a low priority task encodes and writes it
+// stream format: "GXL" 0x01, then per record a byte of (kind << 4 | expander index), varint delta milliseconds
+// since the previous record (the first one is since boot), varint device and zigzag varint value
+// extras/decode_event_log.py turns a captured stream back into text
+class GpioExpanderEventLog
+{
+    // the host tests under dev/GpioLibDevProject/test drain the log directly
+    friend struct GpioExpanderNativeTest;
+
+    private:
+        static void GpioExpanderEventLogTask(void *parameter);
+        static void Drain();
+        static size_t Encode(uint8_t *data, uint8_t kind, uint8_t expanderIndex, uint32_t deltaMs, uint32_t device, int32_t value);
+
+    public:
+        static bool Start(GpioExpanderLogSink *sink, UBaseType_t priority = 0);
+        static void Stop();
+        static bool IsRunning();
+        static uint32_t GetDropped();
+        static void Record(GpioExpanderLogKind kind, GpioExpander *expander, uint32_t device, int32_t value);
+};
+
+#endif //GPIOEXPANDEREVENTLOG_H
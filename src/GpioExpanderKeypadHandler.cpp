@@ -0,0 +1,111 @@
+#include "GpioExpanderLib.h"
+
+QueueHandle_t xGpioExpanderKeypadEventQueue = nullptr;
+
+// find the keys that cannot be trusted in a raw scan
+// without diodes, three keys on the corners of a rectangle make the fourth corner read as pressed,
+// so whenever two rows share two or more pressed columns every key in those columns of both rows is ambiguous
+uint64_t GpioExpanderKeypadGhostKeys(uint64_t keys, uint8_t rows, uint8_t cols)
+{
+    uint64_t ghostKeys = 0;
+    uint64_t rowBits = (1ULL << cols) - 1;
+
+    for (uint8_t r1=0; r1<rows; r1++)
+    {
+        uint64_t row1 = (keys >> (r1 * cols)) & rowBits;
+        if (row1 == 0)
+        {
+            continue;
+        }
+
+        for (uint8_t r2=r1+1; r2<rows; r2++)
+        {
+            uint64_t row2 = (keys >> (r2 * cols)) & rowBits;
+            uint64_t shared = row1 & row2;
+
+            // more than one bit set in the shared columns
+            if ((shared & (shared - 1)) != 0)
+            {
+                ghostKeys |= shared << (r1 * cols);
+                ghostKeys |= shared << (r2 * cols);
+            }
+        }
+    }
+
+    return ghostKeys;
+}
+
+// compare a raw scan with the held keys and publish one event per key that changed
+// ambiguous keys keep their previous state until the ghosting clears, so every other key still rolls over
+// a press is reported on the first scan, but a release only once the key has read up on two scans a scan interval apart
+void GpioExpanderKeypadHandler(GpioExpander* expander, GpioExpanderKeypad* device, uint64_t keys)
+{
+#if defined(GPIOEXPANDERBUTTONS_FLASH_BUILTIN_LED) && GPIOEXPANDERBUTTONS_FLASH_BUILTIN_LED == TRUE
+    // flash the LED in debug mode
+    digitalWrite(LED_BUILTIN, HIGH);
+#endif
+    unsigned long now = millis();
+
+    uint64_t ghostKeys = device->hasDiodes ? 0 : GpioExpanderKeypadGhostKeys(keys, device->rows, device->cols);
+    uint64_t stableKeys = (keys & ~ghostKeys) | (device->keys & ghostKeys);
+
+    // debounce releases: a held key that reads up for the first time stays held until the next scan
+    uint64_t upKeys = device->keys & ~stableKeys;
+    stableKeys |= upKeys & ~device->releasingKeys;
+    device->releasingKeys = upKeys & ~device->releasingKeys;
+    uint64_t changedKeys = stableKeys ^ device->keys;
+
+    // stage the event
+    GpioExpanderKeypadEvent event;
+    event.expander = expander;
+    event.device = device;
+    event.eventMillis = now;
+
+    // report the start of a ghosting condition once, rather than on every scan
+    if (ghostKeys != 0 && !device->isGhosted)
+    {
+        event.key = 255;
+        event.row = 255;
+        event.col = 255;
+        event.event = KeyGhosted;
+        GpioExpanderPublishEvent(xGpioExpanderKeypadEventQueue, &event, sizeof(event));
+        GpioExpanderEventLog::Record(GpioExpanderLogKeypad, expander, device->index * 256 + event.key, event.event);
+
+        #ifdef GPIOEXPANDERLIB_PRINT_DEBUG
+        Serial.print("keypad ");
+        Serial.print(device->index);
+        Serial.println(" ghosting");
+        #endif
+    }
+    device->isGhosted = ghostKeys != 0;
+
+    for (uint8_t key=0; changedKeys != 0; key++, changedKeys >>= 1)
+    {
+        if (changedKeys & 1)
+        {
+            event.key = key;
+            event.row = key / device->cols;
+            event.col = key % device->cols;
+            event.event = (stableKeys & (1ULL << key)) ? KeyPressed : KeyReleased;
+
+            // send a key change to the queue
+            GpioExpanderPublishEvent(xGpioExpanderKeypadEventQueue, &event, sizeof(event));
+            GpioExpanderEventLog::Record(GpioExpanderLogKeypad, expander, device->index * 256 + event.key, event.event);
+
+            #ifdef GPIOEXPANDERLIB_PRINT_DEBUG
+            Serial.print("keypad ");
+            Serial.print(device->index);
+            Serial.print(" key ");
+            Serial.print(key);
+            Serial.println(event.event == KeyPressed ? " pressed" : " released");
+            #endif
+        }
+    }
+
+    device->keys = stableKeys;
+
+#if defined(GPIOEXPANDERBUTTONS_FLASH_BUILTIN_LED) && GPIOEXPANDERBUTTONS_FLASH_BUILTIN_LED == TRUE
+    // clear the LED flash in debug mode
+    digitalWrite(LED_BUILTIN, LOW);
+#endif
+}
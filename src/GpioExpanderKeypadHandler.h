@@ -0,0 +1,21 @@
+#ifndef GPIOEXPANDERKEYPADHANDLER_H
+#define GPIOEXPANDERKEYPADHANDLER_H
+
+// queue of keypad events published by the service task, created by the first GpioExpander::Init()
+extern QueueHandle_t xGpioExpanderKeypadEventQueue;
+
+struct GpioExpanderKeypadEvent
+{
+    uint8_t key;    // row * cols + col, or 255 for a KeyGhosted event
+    uint8_t row;
+    uint8_t col;
+    GpioExpanderKeypadEventEnum event;
+    GpioExpander* expander;
+    GpioExpanderKeypad* device;
+    unsigned long eventMillis;
+};
+
+uint64_t GpioExpanderKeypadGhostKeys(uint64_t keys, uint8_t rows, uint8_t cols);
+void GpioExpanderKeypadHandler(GpioExpander* expander, GpioExpanderKeypad* device, uint64_t keys);
+
+#endif //GPIOEXPANDERKEYPADHANDLER_H
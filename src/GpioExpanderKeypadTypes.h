@@ -0,0 +1,28 @@
+#ifndef GPIOEXPANDERKEYPADTYPES_H
+#define GPIOEXPANDERKEYPADTYPES_H
+
+#define GPIOEXPANDER_KEYPAD_MAX_ROWS 8
+#define GPIOEXPANDER_KEYPAD_MAX_COLS 8
+
+enum GpioExpanderKeypadEventEnum {KeyPressed, KeyReleased, KeyGhosted};
+
+struct GpioExpanderKeypad
+{
+    bool isUsed = false;
+    uint8_t rows = 0;
+    uint8_t cols = 0;
+    uint8_t rowPins[GPIOEXPANDER_KEYPAD_MAX_ROWS];  // outputs, all low while idle
+    uint8_t colPins[GPIOEXPANDER_KEYPAD_MAX_COLS];  // inputs with pullups and interrupts
+    uint16_t rowMask = 0;
+    uint16_t colMask = 0;
+    unsigned long scanIntervalMs = 10;
+    bool hasDiodes = false;     // every key has a diode, so rows can be scanned through the latch and cannot ghost
+    unsigned long lastScanMs = 0;
+    bool isScanning = false;    // a key is down, so the service task is polling instead of waiting for an interrupt
+    bool isGhosted = false;     // the last scan contained keys that cannot be told apart from phantom presses
+    uint64_t keys = 0;          // one bit per key (row * cols + col), set while the key is held
+    uint64_t releasingKeys = 0; // held keys that read up on the last scan, released if they still read up on the next
+    uint8_t index = 255;
+};
+
+#endif //GPIOEXPANDERKEYPADTYPES_H
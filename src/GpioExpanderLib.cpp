@@ -0,0 +1,1199 @@
+#include "GpioExpanderLib.h"
+
+#include <esp_timer.h>
+#include <esp_sleep.h>
+#include <driver/gpio.h>
+
+// task notification for interrupt and background processing
+// these live in this translation unit only so that every module in the firmware shares one service task and registry
+static TaskHandle_t xGpioExpanderTaskToNotify = nullptr;
+
+// events that could not be queued while the service task held a device lock
+// a consumer that reconfigures devices in response to an event would otherwise deadlock against a full queue
+#ifndef GPIOEXPANDER_MAX_DEFERRED_EVENTS
+#define GPIOEXPANDER_MAX_DEFERRED_EVENTS 64
+#endif
+
+union GpioExpanderAnyEvent
+{
+    GpioExpanderButtonEvent button;
+    GpioExpanderRotaryEncoderEvent rotaryEncoder;
+    GpioExpanderKeypadEvent keypad;
+    GpioExpanderCodedSwitchEvent codedSwitch;
+};
+
+struct GpioExpanderDeferredEvent
+{
+    QueueHandle_t queue;
+    GpioExpanderAnyEvent event;
+};
+
+static GpioExpanderDeferredEvent GpioExpanderDeferredEvents[GPIOEXPANDER_MAX_DEFERRED_EVENTS];
+static uint8_t GpioExpanderDeferredCount = 0;
+
+// global dictionary of registered expanders so that event handler can look up which one raised the interrupt
+static GpioExpander *GlobalGpioExpanders[GPIOEXPANDER_MAX_EXPANDERS] = {};
+
+// idle policy and accounting shared by all expanders, the stats are guarded as they are read from other tasks
+static GpioExpanderIdlePolicy GpioExpanderIdlePolicyValue = GpioExpanderIdleAwake;
+static bool GpioExpanderSleepArmed = false;
+static GpioExpanderIdleStats GpioExpanderIdleStatsValue;
+static portMUX_TYPE GpioExpanderIdleStatsMux = portMUX_INITIALIZER_UNLOCKED;
+
+// constructor
+GpioExpander::GpioExpander(uint8_t maxButtons, uint8_t maxRotaryEncoders, uint8_t maxKeypads, uint8_t maxCodedSwitches)
+{
+    _expander = nullptr;
+    _index = 255;
+    _configuredPins = 0;
+    _configuredOutputs = 0;
+    _deviceLock = nullptr;
+    _buttons = nullptr;
+    _rotaryEncoders = nullptr;
+    _keypads = nullptr;
+    _codedSwitches = nullptr;
+
+    _maxButtons = maxButtons;
+    if (maxButtons > 0)
+    {
+        _buttons = new GpioExpanderButton[maxButtons];
+    }
+
+    _maxRotaryEncoders = maxRotaryEncoders;
+    if (maxRotaryEncoders > 0)
+    {
+        _rotaryEncoders = new GpioExpanderRotaryEncoder[maxRotaryEncoders];
+    }
+
+    _maxKeypads = maxKeypads;
+    if (maxKeypads > 0)
+    {
+        _keypads = new GpioExpanderKeypad[maxKeypads];
+    }
+
+    _maxCodedSwitches = maxCodedSwitches;
+    if (maxCodedSwitches > 0)
+    {
+        _codedSwitches = new GpioExpanderCodedSwitch[maxCodedSwitches];
+    }
+}
+
+// Hardware Interrupt Service Routine (ISR) for handling button interrupts
+void IRAM_ATTR GpioExpander::GpioExpanderInterrupt() 
+{
+    // in ISR must be fast and cannot reach out to a sensor over the wire, so notify a lower priority task that an interrupt has occured
+    // notify the button handler that a hardware interrupt has occured
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+    vTaskNotifyGiveFromISR(xGpioExpanderTaskToNotify, &xHigherPriorityTaskWoken);
+
+    // yield processor to other tasks
+    portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+}
+
+void GpioExpander::GpioExpanderServiceTask(void *parameter) 
+{
+    uint16_t allPins;   //pin status while this interrupt occured
+    static uint32_t thread_notification;
+    uint32_t ulNotifiedValue;
+    int64_t activeSince = esp_timer_get_time();
+
+    // continuously process new task notifications from interrupt handler
+    while(1) 
+    {
+        // wait for a task notification raised from the interrupt handler
+        // only a held keypad key or a settling switch makes us wake on a timer, otherwise we sleep until the next interrupt
+        // and there is no periodic wake or bus traffic at all
+        int64_t idleSince = esp_timer_get_time();
+        thread_notification = xTaskNotifyWait(pdTRUE, ULONG_MAX, &ulNotifiedValue, GetServiceWaitTicks());
+        int64_t wokenAt = esp_timer_get_time();
+
+        // account for the time spent blocked versus handling the previous wake
+        portENTER_CRITICAL(&GpioExpanderIdleStatsMux);
+        GpioExpanderIdleStatsValue.activeUs += idleSince - activeSince;
+        GpioExpanderIdleStatsValue.idleUs += wokenAt - idleSince;
+        if (thread_notification == pdPASS)
+        {
+            GpioExpanderIdleStatsValue.interruptWakes++;
+        }
+        else
+        {
+            GpioExpanderIdleStatsValue.timedWakes++;
+        }
+        portEXIT_CRITICAL(&GpioExpanderIdleStatsMux);
+        activeSince = wokenAt;
+
+        if (thread_notification == pdPASS)
+        {
+#if defined(GPIOEXPANDERBUTTONS_FLASH_BUILTIN_LED) && GPIOEXPANDERBUTTONS_FLASH_BUILTIN_LED == TRUE
+            // flash the LED in debug mode
+            digitalWrite(LED_BUILTIN, HIGH);
+#endif
+            // find the correct expander
+            bool bDone = false;
+            GpioExpander *expander = nullptr;
+            uint8_t expanderNumber = 255;
+
+            // loop through the array until you find one that has a pending interrupt
+            for (int i=0; i<GPIOEXPANDER_MAX_EXPANDERS && !bDone; i++)
+            {
+                expander = GlobalGpioExpanders[i];
+                if (expander != nullptr)
+                {
+                    // check to see if the interrupt line is low
+                    // this is the MCU pin wired to INTA/B, so checking it costs no bus traffic
+                    if (::digitalRead(expander->GetInterruptPin()) == LOW)
+                    {
+                        // this one has an interrupt for us
+                        bDone = true;
+                        expanderNumber = i;
+                    }
+                }
+            }
+
+            // check that we found one interrupt line that was active
+            if (expanderNumber != 255)
+            {
+                // hold the device tables while dispatching so that runtime reconfiguration cannot change them underneath us
+                expander->LockDevices();
+
+                // get the details from the GPIO expander based on the last interrupt
+                uint8_t pin = 255;
+                pin = expander->getLastInterruptPin();
+                if (pin != 255)
+                {
+                    // retrieve all the pin states as of the time of the last interrupt
+                    allPins = expander->getCapturedInterrupt();
+
+                    // clear the interrupt, enabling the expander chip to raise a new interrupt
+                    expander->clearInterrupts();
+
+                    expander->DispatchDevices(allPins, pin);
+                }
+
+                expander->UnlockDevices();
+                FlushDeferredEvents();
+            }
+#if defined(GPIOEXPANDERBUTTONS_FLASH_BUILTIN_LED) && GPIOEXPANDERBUTTONS_FLASH_BUILTIN_LED == TRUE
+            // clear the LED flash in debug mode
+            digitalWrite(LED_BUILTIN, LOW);
+#endif
+        }
+
+        // scan any keypads that have a key held down and report any switches that have settled
+        ServiceTimers();
+    }
+}
+
+// hand a snapshot of the pins to every device that may be interested in it
+// pin is the one that raised the interrupt, or 255 when the snapshot was not caused by an interrupt
+void GpioExpander::DispatchDevices(uint16_t allPins, uint8_t pin)
+{
+    // find out which device is attached to this pin
+    // check for the buttons, also catching any button that changed while another pin held the interrupt
+    for (uint8_t i=0; i<GetMaxButtons(); i++)
+    {
+        GpioExpanderButton *device = GetButton(i);
+        if (device != nullptr && device->isUsed &&
+            (device->pin == pin || GPIOEXPANDERBUTTONS_PIN_STATE(allPins, device->pin) != device->lastState))
+        {
+            GpioExpanderButtonHandler(this, device->pin, device, GPIOEXPANDERBUTTONS_PIN_STATE(allPins, device->pin));
+        }
+    }
+
+    // process all rotary encoders
+    for (uint8_t i=0; i<GetMaxRotaryEncoders(); i++)
+    {
+        GpioExpanderRotaryEncoder *device = GetRotaryEncoder(i);
+        if (device != nullptr && device->isUsed)
+        {
+            GpioExpanderRotaryEncoderHandler(this, device, 
+                    GPIOEXPANDERBUTTONS_PIN_STATE(allPins, device->pin1), 
+                    GPIOEXPANDERBUTTONS_PIN_STATE(allPins, device->pin2));
+        }
+    }
+
+    // a low column on an idle keypad means a key went down, so start scanning it
+    for (uint8_t i=0; i<GetMaxKeypads(); i++)
+    {
+        GpioExpanderKeypad *device = GetKeypad(i);
+        if (device != nullptr && device->isUsed && !device->isScanning && (allPins & device->colMask) != device->colMask)
+        {
+            device->isScanning = true;
+            device->lastScanMs = millis() - device->scanIntervalMs;
+        }
+    }
+
+    // process all coded switches
+    for (uint8_t i=0; i<GetMaxCodedSwitches(); i++)
+    {
+        GpioExpanderCodedSwitch *device = GetCodedSwitch(i);
+        if (device != nullptr && device->isUsed)
+        {
+            GpioExpanderCodedSwitchHandler(this, device, allPins);
+        }
+    }
+}
+
+// work out how long the service task can sleep before a keypad needs scanning or a switch has settled
+TickType_t GpioExpander::GetServiceWaitTicks()
+{
+    TickType_t waitTicks = portMAX_DELAY;
+    unsigned long now = millis();
+
+    for (int e=0; e<GPIOEXPANDER_MAX_EXPANDERS; e++)
+    {
+        GpioExpander *expander = GlobalGpioExpanders[e];
+        if (expander == nullptr)
+        {
+            continue;
+        }
+
+        for (uint8_t i=0; i<expander->GetMaxKeypads(); i++)
+        {
+            GpioExpanderKeypad *device = expander->GetKeypad(i);
+            if (device != nullptr && device->isUsed && device->isScanning)
+            {
+                unsigned long elapsed = now - device->lastScanMs;
+                unsigned long remaining = elapsed >= device->scanIntervalMs ? 0 : device->scanIntervalMs - elapsed;
+                TickType_t ticks = pdMS_TO_TICKS(remaining);
+                if (ticks < waitTicks)
+                {
+                    waitTicks = ticks;
+                }
+            }
+        }
+
+        for (uint8_t i=0; i<expander->GetMaxCodedSwitches(); i++)
+        {
+            GpioExpanderCodedSwitch *device = expander->GetCodedSwitch(i);
+            if (device != nullptr && device->isUsed && device->isSettling)
+            {
+                unsigned long elapsed = now - device->pendingSinceMs;
+                unsigned long remaining = elapsed >= device->settleMs ? 0 : device->settleMs - elapsed;
+                TickType_t ticks = pdMS_TO_TICKS(remaining);
+                if (ticks < waitTicks)
+                {
+                    waitTicks = ticks;
+                }
+            }
+        }
+    }
+
+    return waitTicks;
+}
+
+// scan every keypad that has a key down and whose scan interval has elapsed
+// and report every coded switch whose settle time has elapsed
+void GpioExpander::ServiceTimers()
+{
+    for (int e=0; e<GPIOEXPANDER_MAX_EXPANDERS; e++)
+    {
+        GpioExpander *expander = GlobalGpioExpanders[e];
+        if (expander == nullptr)
+        {
+            continue;
+        }
+
+        expander->LockDevices();
+
+        bool scanned = false;
+        for (uint8_t i=0; i<expander->GetMaxKeypads(); i++)
+        {
+            GpioExpanderKeypad *device = expander->GetKeypad(i);
+            if (device != nullptr && device->isUsed && device->isScanning && millis() - device->lastScanMs >= device->scanIntervalMs)
+            {
+                device->lastScanMs = millis();
+                uint64_t keys = expander->ScanKeypad(device);
+                GpioExpanderKeypadHandler(expander, device, keys);
+
+                // once every key is up and its release has been confirmed, fall back to waiting for a column interrupt
+                device->isScanning = keys != 0 || device->keys != 0;
+                scanned = true;
+            }
+        }
+
+        uint16_t allPins = 0;
+        bool haveAllPins = false;
+
+        if (scanned)
+        {
+            // scanning toggles the column inputs and raises interrupts of its own
+            // reading the pins clears them, and anything else that changed meanwhile is dispatched from the same read
+            allPins = expander->_expander->readGPIOAB();
+            haveAllPins = true;
+            expander->DispatchDevices(allPins, 255);
+        }
+
+        for (uint8_t i=0; i<expander->GetMaxCodedSwitches(); i++)
+        {
+            GpioExpanderCodedSwitch *device = expander->GetCodedSwitch(i);
+            if (device != nullptr && device->isUsed && device->isSettling && millis() - device->pendingSinceMs >= device->settleMs)
+            {
+                // one read confirms every switch on this expander that settled at the same time
+                if (!haveAllPins)
+                {
+                    allPins = expander->_expander->readGPIOAB();
+                    haveAllPins = true;
+                }
+                GpioExpanderCodedSwitchSettle(expander, device, allPins);
+            }
+        }
+
+        expander->UnlockDevices();
+        FlushDeferredEvents();
+    }
+}
+
+// drive each row low in turn and read back the columns in one burst per row
+uint64_t GpioExpander::ScanKeypad(GpioExpanderKeypad *keypad)
+{
+    uint64_t keys = 0;
+    uint16_t latch = 0;
+
+    if (keypad->hasDiodes)
+    {
+        // the diodes stop a high row from feeding a low one, so every row stays an output and only the latch changes
+        // every latch write starts from the most recent pin levels and only changes the row bits,
+        // so outputs the application drives on this expander keep their state even if it writes them during a scan
+        // only a write landing between a read and the next latch write can be lost, as with any shared read-modify-write
+        latch = _expander->readGPIOAB() & ~keypad->rowMask;
+    }
+
+    for (uint8_t r=0; r<keypad->rows; r++)
+    {
+        uint16_t row = GPIOEXPANDERBUTTONS_PIN(keypad->rowPins[r]);
+
+        if (keypad->hasDiodes)
+        {
+            _expander->writeGPIOAB(latch | (keypad->rowMask & ~row));
+        }
+        else if (r == 0)
+        {
+            // without diodes two pressed keys in one column would short a high row to the low one,
+            // so the rows that are not being scanned are released to inputs instead of being driven high
+            // their latches stay low, so turning a row back into an output drives it low
+            for (uint8_t other=1; other<keypad->rows; other++)
+            {
+                _expander->pinMode(keypad->rowPins[other], INPUT);
+            }
+        }
+        else
+        {
+            _expander->pinMode(keypad->rowPins[r - 1], INPUT);
+            _expander->pinMode(keypad->rowPins[r], OUTPUT);
+        }
+
+        uint16_t allPins = _expander->readGPIOAB();
+        if (keypad->hasDiodes)
+        {
+            // the column read doubles as the fresh read for the next latch write
+            latch = allPins & ~keypad->rowMask;
+        }
+
+        for (uint8_t c=0; c<keypad->cols; c++)
+        {
+            if (GPIOEXPANDERBUTTONS_PIN_PRESSED(allPins, keypad->colPins[c]))
+            {
+                keys |= 1ULL << (r * keypad->cols + c);
+            }
+        }
+    }
+
+    // return to the idle state with every row low, so any key press pulls its column down and interrupts
+    if (keypad->hasDiodes)
+    {
+        _expander->writeGPIOAB(latch);
+    }
+    else
+    {
+        for (uint8_t r=0; r+1<keypad->rows; r++)
+        {
+            _expander->pinMode(keypad->rowPins[r], OUTPUT);
+        }
+    }
+
+    return keys;
+}
+
+void GpioExpander::Init(Adafruit_MCP23X17 *expander, uint8_t interruptPin)
+{
+    // transfer parameters to private members of the class
+    _expander = expander;
+    _interruptPin = interruptPin;
+
+    // devices can be added and removed after this point, so guard the device tables from the service task
+    if (_deviceLock == nullptr)
+    {
+        _deviceLock = xSemaphoreCreateMutex();
+    }
+
+    // we have to maintain a global list of expanders as there is only one interrupt routine and task notification
+    // add this instance to the global list (so that ISRs can find pins and interrogate chips)
+    bool bDone = false;
+    bool isFirstOne = false;
+
+    for (int i=0; i<GPIOEXPANDER_MAX_EXPANDERS && !bDone; i++)
+    {
+        // check if we are at the end of the array yet (nullptr)
+        if (GlobalGpioExpanders[i] == nullptr)
+        {
+            if (i == 0)
+            {
+                // this is the first one added.  Remember this for later
+                isFirstOne = true;
+            }
+
+            // add this to the list
+            GlobalGpioExpanders[i] = this;
+            _index = i;
+            bDone = true;
+        }
+    }
+
+    // set up the expander module for interrupts
+    _expander->setupInterrupts(true, false, CHANGE);
+
+    // configure the pins of every device added so far, and seed the devices with the current pin states
+    // the service task may already be running for another expander, so hold the device tables while we do this
+    LockDevices();
+    SeedDevices(ConfigurePins());
+
+    // clear any pending interrupts
+    _expander->clearInterrupts();
+    UnlockDevices();
+
+    // we only need one background task for all modules handling the notifications from the interrupt
+    if (isFirstOne)
+    {
+        // initialize a queue to use for the button press events
+        xGpioExpanderButtonEventQueue = xQueueCreate(50, sizeof(GpioExpanderButtonEvent));
+
+        // initialize a queue to use for the rotary encoder events
+        xGpioExpanderRotaryEncoderEventQueue = xQueueCreate(50, sizeof(GpioExpanderRotaryEncoderEvent));
+
+        // initialize a queue to use for the keypad events
+        xGpioExpanderKeypadEventQueue = xQueueCreate(50, sizeof(GpioExpanderKeypadEvent));
+
+        // initialize a queue to use for the coded switch events
+        xGpioExpanderCodedSwitchEventQueue = xQueueCreate(50, sizeof(GpioExpanderCodedSwitchEvent));
+
+        // initiate background task to handle the button presses and rotary events
+        // the queues must exist before the task can publish to them
+        xTaskCreate(
+                GpioExpander::GpioExpanderServiceTask,  // Function to be called
+                "GpioExpander Module Events",   // Name of task
+                3000,         // Stack size (bytes in ESP32, words in FreeRTOS)
+                NULL,         // Parameter to pass to function
+                1,            // Task priority (0 to configMAX_PRIORITIES - 1)
+                &xGpioExpanderTaskToNotify);         // Task handle
+    }
+
+    // configure MCU pin that will receive the interrupt from the GPIO expander
+    // this is done last so that the ISR always has a task to notify
+    pinMode(_interruptPin, INPUT_PULLUP);
+    attachInterrupt(digitalPinToInterrupt(_interruptPin), GpioExpander::GpioExpanderInterrupt, FALLING);
+}
+
+// choose what the MCU may do while all expander pins are stable
+// this applies to every registered expander and to any expander initialized later
+void GpioExpander::SetIdlePolicy(GpioExpanderIdlePolicy policy)
+{
+    GpioExpanderIdlePolicyValue = policy;
+
+    if (policy == GpioExpanderIdleLightSleep)
+    {
+        esp_sleep_enable_gpio_wakeup();
+    }
+}
+
+GpioExpanderIdlePolicy GpioExpander::GetIdlePolicy()
+{
+    return GpioExpanderIdlePolicyValue;
+}
+
+// call this right before esp_light_sleep_start() to arm every expander INT line as a wake source
+// the expander holds INT low until its interrupt is cleared, so a low level wakes the MCU even if the edge was missed
+// a low level GPIO interrupt would fire continuously while awake, so the edge interrupt is detached until NotifyWake()
+void GpioExpander::PrepareSleep()
+{
+    if (GpioExpanderIdlePolicyValue != GpioExpanderIdleLightSleep || GpioExpanderSleepArmed)
+    {
+        return;
+    }
+
+    for (int i=0; i<GPIOEXPANDER_MAX_EXPANDERS; i++)
+    {
+        GpioExpander *expander = GlobalGpioExpanders[i];
+        if (expander != nullptr)
+        {
+            detachInterrupt(digitalPinToInterrupt(expander->GetInterruptPin()));
+            gpio_wakeup_enable((gpio_num_t)expander->GetInterruptPin(), GPIO_INTR_LOW_LEVEL);
+        }
+    }
+    GpioExpanderSleepArmed = true;
+}
+
+// call this after esp_light_sleep_start() returns
+// it disarms the wake sources, restores the falling edge interrupt and services any interrupt that arrived meanwhile
+void GpioExpander::NotifyWake()
+{
+    if (GpioExpanderSleepArmed)
+    {
+        for (int i=0; i<GPIOEXPANDER_MAX_EXPANDERS; i++)
+        {
+            GpioExpander *expander = GlobalGpioExpanders[i];
+            if (expander != nullptr)
+            {
+                gpio_wakeup_disable((gpio_num_t)expander->GetInterruptPin());
+                attachInterrupt(digitalPinToInterrupt(expander->GetInterruptPin()), GpioExpander::GpioExpanderInterrupt, FALLING);
+            }
+        }
+        GpioExpanderSleepArmed = false;
+    }
+
+    // the edge interrupt was detached or lost while asleep, but INT stays low until the expander is serviced
+    for (int i=0; i<GPIOEXPANDER_MAX_EXPANDERS; i++)
+    {
+        GpioExpander *expander = GlobalGpioExpanders[i];
+        if (expander != nullptr && xGpioExpanderTaskToNotify != nullptr && ::digitalRead(expander->GetInterruptPin()) == LOW)
+        {
+            xTaskNotifyGive(xGpioExpanderTaskToNotify);
+            return;
+        }
+    }
+}
+
+GpioExpanderIdleStats GpioExpander::GetIdleStats()
+{
+    portENTER_CRITICAL(&GpioExpanderIdleStatsMux);
+    GpioExpanderIdleStats stats = GpioExpanderIdleStatsValue;
+    portEXIT_CRITICAL(&GpioExpanderIdleStatsMux);
+    return stats;
+}
+
+void GpioExpander::ResetIdleStats()
+{
+    portENTER_CRITICAL(&GpioExpanderIdleStatsMux);
+    GpioExpanderIdleStatsValue = GpioExpanderIdleStats();
+    portEXIT_CRITICAL(&GpioExpanderIdleStatsMux);
+}
+
+// access the interrupt details from the event handler task
+uint16_t GpioExpander::getCapturedInterrupt()
+{
+    return _expander->getCapturedInterrupt();
+}
+
+// access the pin details of the interrupt from the event handler task
+uint8_t GpioExpander::getLastInterruptPin()
+{
+    return _expander->getLastInterruptPin();
+}
+
+// clear the interrupts from within the init and event handler task
+void GpioExpander::clearInterrupts()
+{
+    _expander->clearInterrupts();
+}
+
+uint8_t GpioExpander::digitalRead(uint8_t pin)
+{
+    return _expander->digitalRead(pin);
+}
+
+GpioExpanderButton* GpioExpander::AddButton(uint8_t pin, uint8_t mode)
+{
+    // validate the mode
+    if (mode != CHANGE && mode != LOW && mode!=HIGH)
+    {
+        return nullptr;
+    }
+
+    // validate the pin
+    if (pin >= GetMaxPins())
+    {
+        return nullptr;
+    }
+
+    GpioExpanderButton *button = nullptr;
+
+    LockDevices();
+
+    // check that no other device is already using this pin
+    if ((GetUsedPins() & GPIOEXPANDERBUTTONS_PIN(pin)) == 0)
+    {
+        for (uint8_t i=0; i<GetMaxButtons(); i++)
+        {
+            if (_buttons[i].isUsed == false)
+            {
+                _buttons[i].pin = pin;
+                _buttons[i].isUsed = true;
+                _buttons[i].mode = mode;
+                button = &_buttons[i];
+                break;
+            }
+        }
+    }
+
+    // if we are already running, configure the new pin on the chip right away
+    if (button != nullptr && _expander != nullptr)
+    {
+        SeedDevices(ConfigurePins());
+    }
+
+    UnlockDevices();
+    return button;
+}
+
+GpioExpanderRotaryEncoder* GpioExpander::AddRotaryEncoder (uint8_t pin1, uint8_t pin2, bool fullCycleBetweenDetents, unsigned long debounceMs)
+{
+    // validate the pins
+    if (pin1 >= GetMaxPins() || pin2 >= GetMaxPins() || pin1 == pin2)
+    {
+        return nullptr;
+    }
+
+    GpioExpanderRotaryEncoder *rotaryEncoder = nullptr;
+
+    LockDevices();
+
+    // check that no other device is already using either pin
+    if ((GetUsedPins() & (GPIOEXPANDERBUTTONS_PIN(pin1) | GPIOEXPANDERBUTTONS_PIN(pin2))) == 0)
+    {
+        for (uint8_t i=0; i<GetMaxRotaryEncoders(); i++)
+        {
+            if (_rotaryEncoders[i].isUsed == false)
+            {
+                // this is an empty slot.  Initialize it
+                _rotaryEncoders[i].pin1 = pin1;
+                _rotaryEncoders[i].pin2 = pin2;
+                _rotaryEncoders[i].isUsed = true;
+                _rotaryEncoders[i].fullCycleBetweenDetents = fullCycleBetweenDetents;
+                _rotaryEncoders[i].debounceMs = debounceMs;
+                _rotaryEncoders[i].index = i;
+                _rotaryEncoders[i].lastMovement = Still;
+                rotaryEncoder = &_rotaryEncoders[i];
+                break;
+            }
+        }
+    }
+
+    // if we are already running, configure the new pins on the chip right away
+    if (rotaryEncoder != nullptr && _expander != nullptr)
+    {
+        SeedDevices(ConfigurePins());
+    }
+
+    UnlockDevices();
+    return rotaryEncoder;
+}
+
+bool GpioExpander::RemoveButton(uint8_t pin)
+{
+    bool removed = false;
+
+    LockDevices();
+
+    for (uint8_t i=0; i<GetMaxButtons(); i++)
+    {
+        if (_buttons[i].isUsed && _buttons[i].pin == pin)
+        {
+            // free the slot so it can be reused by a later AddButton
+            _buttons[i].isUsed = false;
+            removed = true;
+            break;
+        }
+    }
+
+    // release the pin on the chip so it no longer raises interrupts
+    if (removed && _expander != nullptr)
+    {
+        ConfigurePins();
+    }
+
+    UnlockDevices();
+    return removed;
+}
+
+bool GpioExpander::RemoveRotaryEncoder(GpioExpanderRotaryEncoder *device)
+{
+    bool removed = false;
+
+    LockDevices();
+
+    for (uint8_t i=0; i<GetMaxRotaryEncoders(); i++)
+    {
+        if (device == &_rotaryEncoders[i] && _rotaryEncoders[i].isUsed)
+        {
+            // free the slot so it can be reused by a later AddRotaryEncoder
+            _rotaryEncoders[i].isUsed = false;
+            removed = true;
+            break;
+        }
+    }
+
+    // release the pins on the chip so they no longer raise interrupts
+    if (removed && _expander != nullptr)
+    {
+        ConfigurePins();
+    }
+
+    UnlockDevices();
+    return removed;
+}
+
+bool GpioExpander::RemapButton(uint8_t pin, uint8_t newPin)
+{
+    if (newPin >= GetMaxPins())
+    {
+        return false;
+    }
+
+    bool remapped = false;
+
+    LockDevices();
+
+    // the new pin must be free, unless it is a remap onto itself
+    if (pin == newPin || (GetUsedPins() & GPIOEXPANDERBUTTONS_PIN(newPin)) == 0)
+    {
+        for (uint8_t i=0; i<GetMaxButtons(); i++)
+        {
+            if (_buttons[i].isUsed && _buttons[i].pin == pin)
+            {
+                _buttons[i].pin = newPin;
+                remapped = true;
+                break;
+            }
+        }
+    }
+
+    // move the pin configuration on the chip, touching only the old and new pins
+    if (remapped && _expander != nullptr)
+    {
+        SeedDevices(ConfigurePins());
+    }
+
+    UnlockDevices();
+    return remapped;
+}
+
+bool GpioExpander::RemapRotaryEncoder(GpioExpanderRotaryEncoder *device, uint8_t pin1, uint8_t pin2)
+{
+    if (pin1 >= GetMaxPins() || pin2 >= GetMaxPins() || pin1 == pin2)
+    {
+        return false;
+    }
+
+    bool remapped = false;
+
+    LockDevices();
+
+    for (uint8_t i=0; i<GetMaxRotaryEncoders(); i++)
+    {
+        if (device == &_rotaryEncoders[i] && _rotaryEncoders[i].isUsed)
+        {
+            // the new pins must be free, other than the ones this encoder already owns
+            uint16_t ownPins = GPIOEXPANDERBUTTONS_PIN(device->pin1) | GPIOEXPANDERBUTTONS_PIN(device->pin2);
+            uint16_t otherPins = GetUsedPins() & ~ownPins;
+            if ((otherPins & (GPIOEXPANDERBUTTONS_PIN(pin1) | GPIOEXPANDERBUTTONS_PIN(pin2))) == 0)
+            {
+                device->pin1 = pin1;
+                device->pin2 = pin2;
+                device->lastMovement = Still;
+                remapped = true;
+            }
+            break;
+        }
+    }
+
+    // move the pin configuration on the chip and reseed the encoder from its new pins
+    if (remapped && _expander != nullptr)
+    {
+        ConfigurePins();
+        SeedDevices(GPIOEXPANDERBUTTONS_PIN(pin1) | GPIOEXPANDERBUTTONS_PIN(pin2));
+    }
+
+    UnlockDevices();
+    return remapped;
+}
+
+GpioExpanderKeypad* GpioExpander::AddKeypadMatrix(const uint8_t *rowPins, uint8_t rows, const uint8_t *colPins, uint8_t cols, unsigned long scanIntervalMs, bool hasDiodes)
+{
+    // validate the matrix size
+    if (rows == 0 || rows > GPIOEXPANDER_KEYPAD_MAX_ROWS || cols == 0 || cols > GPIOEXPANDER_KEYPAD_MAX_COLS)
+    {
+        return nullptr;
+    }
+
+    // validate the pins, which must all be distinct
+    uint16_t rowMask = 0;
+    uint16_t colMask = 0;
+    for (uint8_t r=0; r<rows; r++)
+    {
+        if (rowPins[r] >= GetMaxPins() || (rowMask & GPIOEXPANDERBUTTONS_PIN(rowPins[r])))
+        {
+            return nullptr;
+        }
+        rowMask |= GPIOEXPANDERBUTTONS_PIN(rowPins[r]);
+    }
+    for (uint8_t c=0; c<cols; c++)
+    {
+        if (colPins[c] >= GetMaxPins() || ((rowMask | colMask) & GPIOEXPANDERBUTTONS_PIN(colPins[c])))
+        {
+            return nullptr;
+        }
+        colMask |= GPIOEXPANDERBUTTONS_PIN(colPins[c]);
+    }
+
+    GpioExpanderKeypad *keypad = nullptr;
+
+    LockDevices();
+
+    // check that no other device is already using any of the pins
+    if ((GetUsedPins() & (rowMask | colMask)) == 0)
+    {
+        for (uint8_t i=0; i<GetMaxKeypads(); i++)
+        {
+            if (_keypads[i].isUsed == false)
+            {
+                // this is an empty slot.  Initialize it
+                memcpy(_keypads[i].rowPins, rowPins, rows);
+                memcpy(_keypads[i].colPins, colPins, cols);
+                _keypads[i].rows = rows;
+                _keypads[i].cols = cols;
+                _keypads[i].rowMask = rowMask;
+                _keypads[i].colMask = colMask;
+                _keypads[i].scanIntervalMs = scanIntervalMs;
+                _keypads[i].hasDiodes = hasDiodes;
+                _keypads[i].isScanning = false;
+                _keypads[i].isGhosted = false;
+                _keypads[i].keys = 0;
+                _keypads[i].releasingKeys = 0;
+                _keypads[i].index = i;
+                _keypads[i].isUsed = true;
+                keypad = &_keypads[i];
+                break;
+            }
+        }
+    }
+
+    // if we are already running, configure the new pins on the chip right away
+    if (keypad != nullptr && _expander != nullptr)
+    {
+        SeedDevices(ConfigurePins());
+    }
+
+    UnlockDevices();
+    return keypad;
+}
+
+bool GpioExpander::RemoveKeypadMatrix(GpioExpanderKeypad *device)
+{
+    bool removed = false;
+
+    LockDevices();
+
+    for (uint8_t i=0; i<GetMaxKeypads(); i++)
+    {
+        if (device == &_keypads[i] && _keypads[i].isUsed)
+        {
+            // free the slot so it can be reused by a later AddKeypadMatrix
+            _keypads[i].isUsed = false;
+            _keypads[i].isScanning = false;
+            removed = true;
+            break;
+        }
+    }
+
+    // release the row and column pins on the chip
+    if (removed && _expander != nullptr)
+    {
+        ConfigurePins();
+    }
+
+    UnlockDevices();
+    return removed;
+}
+
+GpioExpanderCodedSwitch* GpioExpander::AddCodedSwitch(const uint8_t *pins, uint8_t pinCount, GpioExpanderCodedSwitchEncoding encoding, unsigned long settleMs)
+{
+    // validate the number of pins
+    if (pinCount == 0 || pinCount > GPIOEXPANDER_CODEDSWITCH_MAX_PINS)
+    {
+        return nullptr;
+    }
+
+    // validate the pins, which must all be distinct
+    uint16_t pinMask = 0;
+    for (uint8_t i=0; i<pinCount; i++)
+    {
+        if (pins[i] >= GetMaxPins() || (pinMask & GPIOEXPANDERBUTTONS_PIN(pins[i])))
+        {
+            return nullptr;
+        }
+        pinMask |= GPIOEXPANDERBUTTONS_PIN(pins[i]);
+    }
+
+    GpioExpanderCodedSwitch *codedSwitch = nullptr;
+
+    LockDevices();
+
+    // check that no other device is already using any of the pins
+    if ((GetUsedPins() & pinMask) == 0)
+    {
+        for (uint8_t i=0; i<GetMaxCodedSwitches(); i++)
+        {
+            if (_codedSwitches[i].isUsed == false)
+            {
+                // this is an empty slot.  Initialize it
+                memcpy(_codedSwitches[i].pins, pins, pinCount);
+                _codedSwitches[i].pinCount = pinCount;
+                _codedSwitches[i].pinMask = pinMask;
+                _codedSwitches[i].encoding = encoding;
+                _codedSwitches[i].settleMs = settleMs;
+                _codedSwitches[i].value = GPIOEXPANDER_CODEDSWITCH_INVALID;
+                _codedSwitches[i].isSettling = false;
+                _codedSwitches[i].index = i;
+                _codedSwitches[i].isUsed = true;
+                codedSwitch = &_codedSwitches[i];
+                break;
+            }
+        }
+    }
+
+    // if we are already running, configure the new pins on the chip right away
+    if (codedSwitch != nullptr && _expander != nullptr)
+    {
+        SeedDevices(ConfigurePins());
+    }
+
+    UnlockDevices();
+    return codedSwitch;
+}
+
+bool GpioExpander::RemoveCodedSwitch(GpioExpanderCodedSwitch *device)
+{
+    bool removed = false;
+
+    LockDevices();
+
+    for (uint8_t i=0; i<GetMaxCodedSwitches(); i++)
+    {
+        if (device == &_codedSwitches[i] && _codedSwitches[i].isUsed)
+        {
+            // free the slot so it can be reused by a later AddCodedSwitch
+            _codedSwitches[i].isUsed = false;
+            _codedSwitches[i].isSettling = false;
+            removed = true;
+            break;
+        }
+    }
+
+    // release the pins on the chip so they no longer raise interrupts
+    if (removed && _expander != nullptr)
+    {
+        ConfigurePins();
+    }
+
+    UnlockDevices();
+    return removed;
+}
+
+// calculate the set of pins claimed by all devices on this expander
+uint16_t GpioExpander::GetUsedPins()
+{
+    uint16_t pins = 0;
+
+    for (uint8_t i=0; i<GetMaxButtons(); i++)
+    {
+        if (_buttons[i].isUsed)
+        {
+            pins |= GPIOEXPANDERBUTTONS_PIN(_buttons[i].pin);
+        }
+    }
+
+    for (uint8_t i=0; i<GetMaxRotaryEncoders(); i++)
+    {
+        if (_rotaryEncoders[i].isUsed)
+        {
+            pins |= GPIOEXPANDERBUTTONS_PIN(_rotaryEncoders[i].pin1) | GPIOEXPANDERBUTTONS_PIN(_rotaryEncoders[i].pin2);
+        }
+    }
+
+    for (uint8_t i=0; i<GetMaxKeypads(); i++)
+    {
+        if (_keypads[i].isUsed)
+        {
+            pins |= _keypads[i].rowMask | _keypads[i].colMask;
+        }
+    }
+
+    for (uint8_t i=0; i<GetMaxCodedSwitches(); i++)
+    {
+        if (_codedSwitches[i].isUsed)
+        {
+            pins |= _codedSwitches[i].pinMask;
+        }
+    }
+
+    return pins;
+}
+
+// calculate the subset of the used pins that are driven as outputs (the keypad rows)
+uint16_t GpioExpander::GetOutputPins()
+{
+    uint16_t pins = 0;
+
+    for (uint8_t i=0; i<GetMaxKeypads(); i++)
+    {
+        if (_keypads[i].isUsed)
+        {
+            pins |= _keypads[i].rowMask;
+        }
+    }
+
+    return pins;
+}
+
+// bring the chip configuration in line with the device tables
+// only pins whose role changed are written, so a runtime add or remove costs a handful of bus transactions
+// returns the set of input pins that were newly configured
+uint16_t GpioExpander::ConfigurePins()
+{
+    uint16_t outputPins = GetOutputPins();
+    uint16_t inputPins = GetUsedPins() & ~outputPins;
+    uint16_t addedInputs = inputPins & ~_configuredPins;
+    uint16_t removedInputs = _configuredPins & ~inputPins;
+    uint16_t addedOutputs = outputPins & ~_configuredOutputs;
+    uint16_t removedOutputs = _configuredOutputs & ~outputPins;
+
+    for (uint8_t pin=0; pin<GetMaxPins(); pin++)
+    {
+        uint16_t bit = GPIOEXPANDERBUTTONS_PIN(pin);
+
+        if (removedInputs & bit)
+        {
+            // stop interrupts first so the pin cannot raise a stray event while it floats
+            _expander->disableInterruptPin(pin);
+        }
+
+        if (addedOutputs & bit)
+        {
+            // latch the idle (low) level before turning the driver on so the pin never glitches high
+            _expander->digitalWrite(pin, LOW);
+            _expander->pinMode(pin, OUTPUT);
+        }
+        else if (addedInputs & bit)
+        {
+            // set the pin mode to input with a pullup resistor, and enable interrupts on state change
+            _expander->pinMode(pin, INPUT_PULLUP);
+            _expander->setupInterruptPin(pin, CHANGE);
+        }
+        else if ((removedInputs | removedOutputs) & bit)
+        {
+            _expander->pinMode(pin, INPUT);
+        }
+    }
+
+    _configuredPins = inputPins;
+    _configuredOutputs = outputPins;
+    return addedInputs;
+}
+
+// seed the in-memory state of devices on the given pins from a single read of the chip
+void GpioExpander::SeedDevices(uint16_t pins)
+{
+    if (pins == 0)
+    {
+        return;
+    }
+
+    uint16_t allPins = _expander->readGPIOAB();
+    unsigned long now = millis();
+
+    for (uint8_t i=0; i<GetMaxButtons(); i++)
+    {
+        if (_buttons[i].isUsed && (pins & GPIOEXPANDERBUTTONS_PIN(_buttons[i].pin)))
+        {
+            _buttons[i].lastState = GPIOEXPANDERBUTTONS_PIN_STATE(allPins, _buttons[i].pin);
+            _buttons[i].lastStateChange = now;
+        }
+    }
+
+    for (uint8_t i=0; i<GetMaxRotaryEncoders(); i++)
+    {
+        if (_rotaryEncoders[i].isUsed && (pins & (GPIOEXPANDERBUTTONS_PIN(_rotaryEncoders[i].pin1) | GPIOEXPANDERBUTTONS_PIN(_rotaryEncoders[i].pin2))))
+        {
+            _rotaryEncoders[i].pin1State = GPIOEXPANDERBUTTONS_PIN_STATE(allPins, _rotaryEncoders[i].pin1) == LOW?0:1;
+            _rotaryEncoders[i].pin2State = GPIOEXPANDERBUTTONS_PIN_STATE(allPins, _rotaryEncoders[i].pin2) == LOW?0:1;
+            _rotaryEncoders[i].lastMovementMs = now;
+        }
+    }
+
+    // a keypad that already has a key down starts out scanning rather than waiting for an interrupt
+    for (uint8_t i=0; i<GetMaxKeypads(); i++)
+    {
+        if (_keypads[i].isUsed && (pins & _keypads[i].colMask) && (allPins & _keypads[i].colMask) != _keypads[i].colMask)
+        {
+            _keypads[i].isScanning = true;
+            _keypads[i].lastScanMs = now - _keypads[i].scanIntervalMs;
+        }
+    }
+
+    // a coded switch starts out at its current position without reporting it
+    for (uint8_t i=0; i<GetMaxCodedSwitches(); i++)
+    {
+        if (_codedSwitches[i].isUsed && (pins & _codedSwitches[i].pinMask))
+        {
+            _codedSwitches[i].value = GpioExpanderCodedSwitchDecode(&_codedSwitches[i], allPins);
+            _codedSwitches[i].isSettling = false;
+        }
+    }
+}
+
+// handlers only run on the service task while it holds a device lock, so they must never block on a full queue
+// the event is queued right away if there is room, otherwise it is kept (in order) until the lock is released
+void GpioExpanderPublishEvent(QueueHandle_t queue, const void *event, size_t size)
+{
+    // once anything has been deferred, later events are deferred too so the consumer sees them in order
+    if (GpioExpanderDeferredCount == 0 && xQueueSend(queue, event, 0) == pdPASS)
+    {
+        return;
+    }
+
+    if (GpioExpanderDeferredCount < GPIOEXPANDER_MAX_DEFERRED_EVENTS && size <= sizeof(GpioExpanderAnyEvent))
+    {
+        GpioExpanderDeferredEvents[GpioExpanderDeferredCount].queue = queue;
+        memcpy(&GpioExpanderDeferredEvents[GpioExpanderDeferredCount].event, event, size);
+        GpioExpanderDeferredCount++;
+    }
+
+    // the consumer is more than a full queue and the deferred buffer behind.  The event is lost
+}
+
+// called by the service task after releasing a device lock; now it is safe to wait for the consumer
+void GpioExpander::FlushDeferredEvents()
+{
+    for (uint8_t i=0; i<GpioExpanderDeferredCount; i++)
+    {
+        xQueueSend(GpioExpanderDeferredEvents[i].queue, &GpioExpanderDeferredEvents[i].event, portMAX_DELAY);
+    }
+    GpioExpanderDeferredCount = 0;
+}
+
+// the lock only exists once Init() has run; before that there is no service task to race with
+void GpioExpander::LockDevices()
+{
+    if (_deviceLock != nullptr)
+    {
+        xSemaphoreTake(_deviceLock, portMAX_DELAY);
+    }
+}
+
+void GpioExpander::UnlockDevices()
+{
+    if (_deviceLock != nullptr)
+    {
+        xSemaphoreGive(_deviceLock);
+    }
+}
@@ -7,74 +7,97 @@
 #include "GpioExpanderMacros.h"
 #include "GpioExpanderButtonTypes.h"
 #include "GpioExpanderRotaryEncoderTypes.h"
+#include "GpioExpanderKeypadTypes.h"
+#include "GpioExpanderCodedSwitchTypes.h"
 
 #define GPIOEXPANDER_MAX_EXPANDERS 8
 
-// task notification and queue for interrupt and background processing
-static QueueHandle_t xGpioExpanderEventQueue;
-static TaskHandle_t xGpioExpanderTaskToNotify;
+// what the MCU may do while every expander pin is stable
+enum GpioExpanderIdlePolicy
+{
+    GpioExpanderIdleAwake,          // the service task blocks on the interrupt, the MCU stays awake
+    GpioExpanderIdleLightSleep      // PrepareSleep() arms every expander INT line as a light-sleep wake source
+};
+
+// time the service task spent blocked versus handling input, since Init() or the last ResetIdleStats()
+struct GpioExpanderIdleStats
+{
+    uint64_t idleUs = 0;            // blocked waiting for an interrupt, a keypad scan or a switch to settle
+    uint64_t activeUs = 0;          // reading the expanders and publishing events
+    uint32_t interruptWakes = 0;    // wakes caused by an expander interrupt
+    uint32_t timedWakes = 0;        // wakes caused by a held keypad key or a settling switch
+};
 
 class GpioExpander
 {
+    // the host tests under dev/GpioLibDevProject/test step the service task directly
+    friend struct GpioExpanderNativeTest;
+
     private:
         static void IRAM_ATTR GpioExpanderInterrupt();
         static void GpioExpanderServiceTask(void *parameter);  
+        static TickType_t GetServiceWaitTicks();
+        static void ServiceTimers();
+        static void FlushDeferredEvents();
         uint8_t _interruptPin;
+        uint8_t _index;     // slot in the global list of expanders
         uint8_t _maxButtons;
         uint8_t _maxRotaryEncoders;
+        uint8_t _maxKeypads;
+        uint8_t _maxCodedSwitches;
         GpioExpanderButton* _buttons;
         GpioExpanderRotaryEncoder* _rotaryEncoders;
+        GpioExpanderKeypad* _keypads;
+        GpioExpanderCodedSwitch* _codedSwitches;
+        uint16_t _configuredPins;       // pins currently configured on the chip as inputs with interrupts
+        uint16_t _configuredOutputs;    // pins currently configured on the chip as outputs
+        SemaphoreHandle_t _deviceLock;  // guards the device tables and the bus while the service task is running
+        uint16_t GetUsedPins();
+        uint16_t GetOutputPins();
+        uint16_t ConfigurePins();
+        void SeedDevices(uint16_t pins);
+        void LockDevices();
+        void UnlockDevices();
+        void DispatchDevices(uint16_t allPins, uint8_t pin);
+        uint64_t ScanKeypad(GpioExpanderKeypad *keypad);
 
     public: 
-        GpioExpander(uint8_t maxButtons=16, uint8_t maxRotaryEncoders=8);
+        GpioExpander(uint8_t maxButtons=16, uint8_t maxRotaryEncoders=8, uint8_t maxKeypads=1, uint8_t maxCodedSwitches=4);
         void Init(Adafruit_MCP23X17 *expander, uint8_t interruptPin);
         GpioExpanderButton* AddButton(uint8_t pin, uint8_t mode=LOW);
         GpioExpanderRotaryEncoder* AddRotaryEncoder (uint8_t pin1, uint8_t pin2, bool fullCycleBetweenDetents = false, unsigned long debounceMs = 200);
+        GpioExpanderKeypad* AddKeypadMatrix(const uint8_t *rowPins, uint8_t rows, const uint8_t *colPins, uint8_t cols, unsigned long scanIntervalMs = 10, bool hasDiodes = false);
+        GpioExpanderCodedSwitch* AddCodedSwitch(const uint8_t *pins, uint8_t pinCount, GpioExpanderCodedSwitchEncoding encoding, unsigned long settleMs = 20);
+        bool RemoveButton(uint8_t pin);
+        bool RemoveRotaryEncoder(GpioExpanderRotaryEncoder *device);
+        bool RemapButton(uint8_t pin, uint8_t newPin);
+        bool RemapRotaryEncoder(GpioExpanderRotaryEncoder *device, uint8_t pin1, uint8_t pin2);
+        bool RemoveKeypadMatrix(GpioExpanderKeypad *device);
+        bool RemoveCodedSwitch(GpioExpanderCodedSwitch *device);
         Adafruit_MCP23X17 *_expander;
+        static void SetIdlePolicy(GpioExpanderIdlePolicy policy);
+        static GpioExpanderIdlePolicy GetIdlePolicy();
+        static GpioExpanderIdleStats GetIdleStats();
+        static void ResetIdleStats();
+        static void PrepareSleep();
+        static void NotifyWake();
         uint8_t GetMaxPins() { return 16; } //maximum number of pins on this expander
         uint8_t GetMaxButtons() { return _maxButtons; }
         uint8_t GetInterruptPin() { return _interruptPin; }
+        uint8_t GetIndex() { return _index; }
         uint8_t GetMaxRotaryEncoders() { return _maxRotaryEncoders;}
+        uint8_t GetMaxKeypads() { return _maxKeypads;}
+        uint8_t GetMaxCodedSwitches() { return _maxCodedSwitches;}
         uint16_t getCapturedInterrupt();
         uint8_t getLastInterruptPin();
         uint8_t digitalRead(uint8_t pin);
         void clearInterrupts();
         GpioExpanderButton *GetButton(uint8_t index) { if  (index < GetMaxButtons()) {return &_buttons[index];}else{return (GpioExpanderButton *)nullptr;}};
         GpioExpanderRotaryEncoder *GetRotaryEncoder(uint8_t index) { if  (index < GetMaxRotaryEncoders()) {return &_rotaryEncoders[index];}else{return (GpioExpanderRotaryEncoder *)nullptr;}};
+        GpioExpanderKeypad *GetKeypad(uint8_t index) { if  (index < GetMaxKeypads()) {return &_keypads[index];}else{return (GpioExpanderKeypad *)nullptr;}};
+        GpioExpanderCodedSwitch *GetCodedSwitch(uint8_t index) { if  (index < GetMaxCodedSwitches()) {return &_codedSwitches[index];}else{return (GpioExpanderCodedSwitch *)nullptr;}};
 };
 
-// global dictionary of registered expanders so that event handler can look up which one raised the interrupt
-static GpioExpander *GlobalGpioExpanders[GPIOEXPANDER_MAX_EXPANDERS] = {};
-
-// constructor
-GpioExpander::GpioExpander(uint8_t maxButtons, uint8_t maxRotaryEncoders)
-{
-    _maxButtons = maxButtons;
-    if (maxButtons > 0)
-    {
-        _buttons = new GpioExpanderButton[maxButtons];
-    }
-
-    _maxRotaryEncoders = maxRotaryEncoders;
-    if (maxRotaryEncoders > 0)
-    {
-        _rotaryEncoders = new GpioExpanderRotaryEncoder[maxRotaryEncoders];
-    }
-}
-
-// Hardware Interrupt Service Routine (ISR) for handling button interrupts
-void IRAM_ATTR GpioExpander::GpioExpanderInterrupt() 
-{
-    // in ISR must be fast and cannot reach out to a sensor over the wire, so notify a lower priority task that an interrupt has occured
-    // notify the button handler that a hardware interrupt has occured
-    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
-    vTaskNotifyGiveFromISR(xGpioExpanderTaskToNotify, &xHigherPriorityTaskWoken);
-
-    // yield processor to other tasks
-    portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
-}
-
-
 // event details
 struct GpioExpanderEvent
 {
@@ -85,260 +108,11 @@ struct GpioExpanderEvent
 
 #include "GpioExpanderButtonHandler.h"
 #include "GpioExpanderRotaryEncoderHandler.h"
+#include "GpioExpanderKeypadHandler.h"
+#include "GpioExpanderCodedSwitchHandler.h"
+#include "GpioExpanderEventLog.h"
 
-void GpioExpander::GpioExpanderServiceTask(void *parameter) 
-{
-    uint16_t allPins;   //pin status while this interrupt occured
-    static uint32_t thread_notification;
-    const TickType_t xMaxBlockTime = pdMS_TO_TICKS( 500 );
-    uint32_t ulNotifiedValue;
-
-    // continuously process new task notifications from interrupt handler
-    while(1) 
-    {
-        // wait for a task notification raised from the interrupt handler
-        thread_notification = xTaskNotifyWait(pdTRUE, ULONG_MAX, &ulNotifiedValue, portMAX_DELAY);
-
-        if (thread_notification == pdPASS)
-        {
-#if GPIOEXPANDERBUTTONS_FLASH_BUILTIN_LED == TRUE
-            // flash the LED in debug mode
-            digitalWrite(LED_BUILTIN, HIGH);
-#endif
-            // find the correct expander
-            bool bDone = false;
-            GpioExpander *expander = nullptr;
-            uint8_t expanderNumber = 255;
-
-            // loop through the array until you find one that has a pending interrupt
-            for (int i=0; i<GPIOEXPANDER_MAX_EXPANDERS && !bDone; i++)
-            {
-                expander = GlobalGpioExpanders[i];
-                if (expander != nullptr)
-                {
-                    // check to see if the interrupt line is low
-                    if (expander->digitalRead(expander->GetInterruptPin()) == LOW)
-                    {
-                        // this one has an interrupt for us
-                        bDone = true;
-                        expanderNumber = i;
-                    }
-                }
-            }
-
-            // check that we found one interrupt line that was active
-            if (expanderNumber != 255)
-            {
-                // get the details from the GPIO expander based on the last interrupt
-                uint8_t pin = 255;
-                pin = expander->getLastInterruptPin();
-                if (pin != 255)
-                {
-                    // retrieve all the pin states as of the time of the last interrupt
-                    allPins = expander->getCapturedInterrupt();
-
-                    // clear the interrupt, enabling the expander chip to raise a new interrupt
-                    expander->clearInterrupts();
-                }
-
-                // find out which device is attached to this pin
-                // check for the buttons
-                for (uint8_t i=0; i<expander->GetMaxButtons(); i++)
-                {
-                    GpioExpanderButton *device = expander->GetButton(i);
-                    if (device != nullptr && device->isUsed && device->pin == pin)
-                    {
-                        
-                        GpioExpanderButtonHandler(expander, pin, device, GPIOEXPANDERBUTTONS_PIN_STATE(allPins, device->pin));
-                        break;
-                    }
-                }
-
-                // process all rotary encoders
-                for (uint8_t i=0; i<expander->GetMaxRotaryEncoders(); i++)
-                {
-                    GpioExpanderRotaryEncoder *device = expander->GetRotaryEncoder(i);
-                    if (device != nullptr && device->isUsed)
-                    {
-                        GpioExpanderRotaryEncoderHandler(expander, device, 
-                                GPIOEXPANDERBUTTONS_PIN_STATE(allPins, device->pin1), 
-                                GPIOEXPANDERBUTTONS_PIN_STATE(allPins, device->pin2));
-                        
-                    }
-                }
-
-            }
-#if GPIOEXPANDERBUTTONS_FLASH_BUILTIN_LED == TRUE
-            // clear the LED flash in debug mode
-            digitalWrite(LED_BUILTIN, LOW);
-#endif
-        }
-    }
-}
-
-void GpioExpander::Init(Adafruit_MCP23X17 *expander, uint8_t interruptPin)
-{
-    // transfer parameters to private members of the class
-    _expander = expander;
-    _interruptPin = interruptPin;
-
-    // we have to maintain a global list of expanders as there is only one interrupt routine and task notification
-    // add this instance to the global list (so that ISRs can find pins and interrogate chips)
-    bool bDone = false;
-    bool isFirstOne = false;
-
-    for (int i=0; i<GPIOEXPANDER_MAX_EXPANDERS && !bDone; i++)
-    {
-        // check if we are at the end of the array yet (nullptr)
-        if (GlobalGpioExpanders[i] == nullptr)
-        {
-            if (i == 0)
-            {
-                // this is the first one added.  Remember this for later
-                isFirstOne = true;
-            }
-
-            // add this to the list
-            GlobalGpioExpanders[i] = this;
-            bDone = true;
-        }
-    }
-
-    // set up the expander module for interrupts
-    _expander->setupInterrupts(true, false, CHANGE);
-
-    // configure each of the buttons for expander interrupts
-    for (int i=0; i<GetMaxButtons(); i++)
-    {
-        // check if this pin is a button
-        if (_buttons[i].isUsed)
-        {
-            // set the button pin mode to input with a pullup resistor, and enable interrupts on state change
-            _expander->pinMode(_buttons[i].pin, INPUT_PULLUP);
-            _expander->setupInterruptPin(_buttons[i].pin, CHANGE);
-        }
-    }
-
-    unsigned long now = millis();
-
-    // configure each of the rotary encoders for expander interrupts
-    for (int i=0; i<GetMaxRotaryEncoders(); i++)
-    {
-        // check if this slot is used
-        if (_rotaryEncoders[i].isUsed)
-        {
-            // set the pin mode to input with a pullup resistor, and enable interrupts on state change
-            _expander->pinMode(_rotaryEncoders[i].pin1, INPUT_PULLUP);
-            _expander->setupInterruptPin(_rotaryEncoders[i].pin1, CHANGE);
-            _expander->pinMode(_rotaryEncoders[i].pin2, INPUT_PULLUP);
-            _expander->setupInterruptPin(_rotaryEncoders[i].pin2, CHANGE);
-
-            // get the current values from expander and seed in-memory ones
-            _rotaryEncoders[i].pin1State = _expander->digitalRead(_rotaryEncoders[i].pin1) == LOW?0:1;
-            _rotaryEncoders[i].pin2State = _expander->digitalRead(_rotaryEncoders[i].pin2) == LOW?0:1;
-            _rotaryEncoders[i].lastMovementMs = now;
-        }
-    }
-
-    // clear any pending interrupts
-    _expander->clearInterrupts();
-
-    // configure MCU pin that will receive the interrupt from the GPIO expander
-    pinMode(_interruptPin, INPUT_PULLUP);
-    attachInterrupt(digitalPinToInterrupt(_interruptPin), GpioExpander::GpioExpanderInterrupt, FALLING);
-
-    // we only need one background task for all modules handling the notifications from the interrupt
-    if (isFirstOne)
-    {
-        // initiate background task to handle the button presses and rotary events
-        xTaskCreate(
-                GpioExpander::GpioExpanderServiceTask,  // Function to be called
-                "GpioExpander Module Events",   // Name of task
-                3000,         // Stack size (bytes in ESP32, words in FreeRTOS)
-                NULL,         // Parameter to pass to function
-                1,            // Task priority (0 to configMAX_PRIORITIES - 1)
-                &xGpioExpanderTaskToNotify);         // Task handle
-
-        // initialize a queue to use for the button press events
-        xGpioExpanderButtonEventQueue = xQueueCreate(50, sizeof(GpioExpanderButtonEvent));
-
-        // initialize a queue to use for the rotary encoder events
-        xGpioExpanderRotaryEncoderEventQueue = xQueueCreate(50, sizeof(GpioExpanderRotaryEncoderEvent));
-    }
-}
-
-// access the interrupt details from the event handler task
-uint16_t GpioExpander::getCapturedInterrupt()
-{
-    return _expander->getCapturedInterrupt();
-}
-
-// access the pin details of the interrupt from the event handler task
-uint8_t GpioExpander::getLastInterruptPin()
-{
-    return _expander->getLastInterruptPin();
-}
-
-// clear the interrupts from within the init and event handler task
-void GpioExpander::clearInterrupts()
-{
-    _expander->clearInterrupts();
-}
-
-uint8_t GpioExpander::digitalRead(uint8_t pin)
-{
-    return _expander->digitalRead(pin);
-}
-
-GpioExpanderButton* GpioExpander::AddButton(uint8_t pin, uint8_t mode)
-{
-    // validate the mode
-    if (mode != CHANGE && mode != LOW && mode!=HIGH)
-    {
-        return nullptr;
-    }
-
-    for (uint8_t i=0; i<GetMaxButtons(); i++)
-    {
-        if (_buttons[i].isUsed == false)
-        {
-            _buttons[i].pin = pin;
-            _buttons[i].isUsed = true;
-            _buttons[i].mode = mode;
-            return &_buttons[i];
-        }
-        else if(_buttons[i].pin == pin)
-        {
-            // this is a duplicate
-            return nullptr;
-        }
-    }
-    return nullptr;
-}
-
-GpioExpanderRotaryEncoder* GpioExpander::AddRotaryEncoder (uint8_t pin1, uint8_t pin2, bool fullCycleBetweenDetents, unsigned long debounceMs)
-{
-    for (uint8_t i=0; i<GetMaxRotaryEncoders(); i++)
-    {
-        if (_rotaryEncoders[i].isUsed == false)
-        {
-            // this is an empty slot.  Initialize it
-            _rotaryEncoders[i].pin1 = pin1;
-            _rotaryEncoders[i].pin2 = pin2;
-            _rotaryEncoders[i].isUsed = true;
-            _rotaryEncoders[i].fullCycleBetweenDetents = fullCycleBetweenDetents;
-            _rotaryEncoders[i].debounceMs = debounceMs;
-            _rotaryEncoders[i].index = i;
+// handlers publish through this rather than xQueueSend, as they run while the service task holds a device lock
+void GpioExpanderPublishEvent(QueueHandle_t queue, const void *event, size_t size);
 
-            return &_rotaryEncoders[i];
-        }
-        else if(_rotaryEncoders[i].pin1 == pin1 || _rotaryEncoders[i].pin2 == pin1 
-            || _rotaryEncoders[i].pin1 == pin2 || _rotaryEncoders[i].pin2 == pin2)
-        {
-            // this is a duplicate
-            return nullptr;
-        }
-    }
-    return nullptr;
-}
 #endif  // GPIOEXPANDERLIB_H